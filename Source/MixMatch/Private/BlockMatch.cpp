@@ -77,12 +77,13 @@ void UBlockMatch::Sort(const bool bForceSort)
 
 void UBlockMatch::Reset()
 {
-	Blocks.Empty();
+	// Keep allocations, matches are pooled and reused by the grid.
+	Blocks.Reset();
 	StartCoords = FIntPoint::NoneValue;
 	EndCoords = FIntPoint::NoneValue;
 	bSorted = false;
 	TotalScore = 0;
-	TotalGoods.Empty();
+	TotalGoods.Reset();
 	Orientation = EMMOrientation::Unknown;
 }
 
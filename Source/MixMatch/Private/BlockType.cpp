@@ -3,3 +3,5 @@
 
 
 const FName BlockCategory::Goods = FName(TEXT("Goods"));
+
+const FName BlockMatchCode::Any = FName(TEXT("Any"));
@@ -0,0 +1,115 @@
+#include "BlockTypeRegistry.h"
+#include "../MixMatch.h"
+
+
+const int16 FBlockTypeRegistry::InvalidId = INDEX_NONE;
+
+
+void FBlockTypeRegistry::Build(const TMap<FName, FBlockType>& BlockTypes)
+{
+	Reset();
+	if (BlockTypes.Num() >= MAX_int16)
+	{
+		UE_LOG(LogMMGame, Error, TEXT("FBlockTypeRegistry::Build - Too many block types (%d)."), BlockTypes.Num());
+		return;
+	}
+	Names.Reserve(BlockTypes.Num());
+	Types.Reserve(BlockTypes.Num());
+	for (const TPair<FName, FBlockType>& It : BlockTypes)
+	{
+		const int16 NewId = (int16)Names.Add(It.Key);
+		Ids.Add(It.Key, NewId);
+		Types.Add(It.Value);
+	}
+	const int32 NumTypes = Names.Num();
+	CompatibilityBits.Init(false, NumTypes * NumTypes);
+	MatchNextToPreviousBits.Init(false, NumTypes);
+	ImmobileBits.Init(false, NumTypes);
+	for (int32 A = 0; A < NumTypes; A++)
+	{
+		const FBlockType& TypeA = Types[A];
+		MatchNextToPreviousBits[A] = TypeA.bMatchNextToPreviousInMatchGroup;
+		ImmobileBits[A] = TypeA.bImmobile;
+		for (int32 B = 0; B < NumTypes; B++) {
+			CompatibilityBits[(A * NumTypes) + B] = TypeA == Types[B];
+		}
+	}
+	BuildMatchClasses();
+	UE_LOG(LogMMGame, Log, TEXT("FBlockTypeRegistry::Build - Registered %d block types in %d match classes"), NumTypes, NumMatchClasses);
+}
+
+
+void FBlockTypeRegistry::Reset()
+{
+	Names.Empty();
+	Types.Empty();
+	Ids.Empty();
+	CompatibilityBits.Empty();
+	MatchNextToPreviousBits.Empty();
+	ImmobileBits.Empty();
+	MatchClasses.Empty();
+	NumMatchClasses = 0;
+}
+
+
+int16 FBlockTypeRegistry::GetTypeId(const FName& BlockTypeName) const
+{
+	const int16* FoundId = Ids.Find(BlockTypeName);
+	return FoundId ? *FoundId : InvalidId;
+}
+
+
+FName FBlockTypeRegistry::GetTypeName(const int16 TypeId) const
+{
+	return IsValidId(TypeId) ? Names[TypeId] : NAME_None;
+}
+
+
+const FBlockType* FBlockTypeRegistry::FindType(const FName& BlockTypeName) const
+{
+	return GetType(GetTypeId(BlockTypeName));
+}
+
+
+void FBlockTypeRegistry::BuildMatchClasses()
+{
+	const int32 NumTypes = Names.Num();
+	MatchClasses.Init(INDEX_NONE, NumTypes);
+	NumMatchClasses = 0;
+	if (MatchNextToPreviousBits.Contains(true)) {
+		return;
+	}
+	// Put each type in the class of the first earlier type it matches, or start a new class.
+	int32 ClassCount = 0;
+	for (int16 A = 0; A < NumTypes; A++)
+	{
+		if (!Matches(A, A)) {
+			continue;
+		}
+		for (int16 B = 0; B < A; B++)
+		{
+			if (MatchClasses[B] != INDEX_NONE && Matches(A, B)) 
+			{
+				MatchClasses[A] = MatchClasses[B];
+				break;
+			}
+		}
+		if (MatchClasses[A] == INDEX_NONE) {
+			MatchClasses[A] = (int16)ClassCount++;
+		}
+	}
+	// Classes are only usable if matching is exactly "same class".
+	for (int16 A = 0; A < NumTypes; A++)
+	{
+		for (int16 B = 0; B < NumTypes; B++)
+		{
+			const bool bSameClass = MatchClasses[A] != INDEX_NONE && MatchClasses[A] == MatchClasses[B];
+			if (Matches(A, B) != bSameClass) 
+			{
+				MatchClasses.Init(INDEX_NONE, NumTypes);
+				return;
+			}
+		}
+	}
+	NumMatchClasses = ClassCount;
+}
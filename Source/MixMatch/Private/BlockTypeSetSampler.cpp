@@ -0,0 +1,122 @@
+#include "BlockTypeSetSampler.h"
+#include "../MixMatch.h"
+
+
+void FBlockTypeSetSampler::Build(const FWeightedBlockTypeSet& BlockTypeSet, const FBlockTypeRegistry& Registry)
+{
+	SetName = BlockTypeSet.Name;
+	BlockTypeNames.Reset(BlockTypeSet.WeightedBlockTypes.Num());
+	TypeIds.Reset(BlockTypeSet.WeightedBlockTypes.Num());
+	Weights.Reset(BlockTypeSet.WeightedBlockTypes.Num());
+	ImmobileBits.Empty(BlockTypeSet.WeightedBlockTypes.Num());
+	ImmobileMask = 0;
+	EntryIndexes.Empty(BlockTypeSet.WeightedBlockTypes.Num());
+	ExclusionTables.Empty();
+	for (const FWeightedBlockType& WBT : BlockTypeSet.WeightedBlockTypes)
+	{
+		const int16 TypeId = Registry.GetTypeId(WBT.BlockTypeName);
+		if (!Registry.IsValidId(TypeId))
+		{
+			UE_LOG(LogMMGame, Error, TEXT("FBlockTypeSetSampler::Build - Block type %s in BlockTypeSet %s not found"), *WBT.BlockTypeName.ToString(), *SetName.ToString());
+			continue;
+		}
+		const int32 Index = BlockTypeNames.Add(WBT.BlockTypeName);
+		EntryIndexes.FindOrAdd(WBT.BlockTypeName, Index);
+		TypeIds.Add(TypeId);
+		Weights.Add(WBT.Weight);
+		ImmobileBits.Add(Registry.IsImmobile(TypeId));
+		if (Index < MaxMaskedEntries && Registry.IsImmobile(TypeId)) {
+			ImmobileMask |= 1ULL << Index;
+		}
+	}
+	AllTypesTable.Build(Weights);
+}
+
+
+FName FBlockTypeSetSampler::Pick(const TArray<FName>& ExcludedBlockNames, const TArray<FName>& ForbiddenBlockNames, const bool bPreventImmobile, FRandomStream& RandStream)
+{
+	if (ExcludedBlockNames.Num() == 0 && ForbiddenBlockNames.Num() == 0 && !bPreventImmobile)
+	{
+		const int32 Picked = AllTypesTable.Sample(RandStream);
+		return Picked == INDEX_NONE ? PickFallback(ForbiddenBlockNames, false, RandStream) : BlockTypeNames[Picked];
+	}
+	const FMMAliasTable* Table = nullptr;
+	FMMAliasTable UncachedTable;
+	if (Num() <= MaxMaskedEntries)
+	{
+		uint64 Mask = bPreventImmobile ? ImmobileMask : 0;
+		for (const FName& ExcludedName : ExcludedBlockNames)
+		{
+			if (const int32* Index = EntryIndexes.Find(ExcludedName)) {
+				Mask |= 1ULL << *Index;
+			}
+		}
+		for (const FName& ForbiddenName : ForbiddenBlockNames)
+		{
+			if (const int32* Index = EntryIndexes.Find(ForbiddenName)) {
+				Mask |= 1ULL << *Index;
+			}
+		}
+		Table = Mask == 0 ? &AllTypesTable : ExclusionTables.Find(Mask);
+		if (Table == nullptr)
+		{
+			if (ExclusionTables.Num() < MaxExclusionTables)
+			{
+				FMMAliasTable& NewTable = ExclusionTables.Add(Mask);
+				BuildExclusionTable(ExcludedBlockNames, ForbiddenBlockNames, bPreventImmobile, NewTable);
+				Table = &NewTable;
+			}
+			else
+			{
+				BuildExclusionTable(ExcludedBlockNames, ForbiddenBlockNames, bPreventImmobile, UncachedTable);
+				Table = &UncachedTable;
+			}
+		}
+	}
+	else
+	{
+		BuildExclusionTable(ExcludedBlockNames, ForbiddenBlockNames, bPreventImmobile, UncachedTable);
+		Table = &UncachedTable;
+	}
+	const int32 Picked = Table->Sample(RandStream);
+	// If we ended up with no block types allowed, then pick a random one to add
+	return Picked == INDEX_NONE ? PickFallback(ForbiddenBlockNames, bPreventImmobile, RandStream) : BlockTypeNames[Picked];
+}
+
+
+void FBlockTypeSetSampler::BuildExclusionTable(const TArray<FName>& ExcludedBlockNames, const TArray<FName>& ForbiddenBlockNames, const bool bPreventImmobile, FMMAliasTable& OutTable) const
+{
+	TArray<float> AllowedWeights;
+	AllowedWeights.SetNumUninitialized(Num());
+	for (int32 Index = 0; Index < Num(); Index++) {
+		AllowedWeights[Index] = IsAllowed(Index, ExcludedBlockNames, ForbiddenBlockNames, bPreventImmobile) ? Weights[Index] : 0.f;
+	}
+	OutTable.Build(AllowedWeights);
+}
+
+
+FName FBlockTypeSetSampler::PickFallback(const TArray<FName>& ForbiddenBlockNames, const bool bPreventImmobile, FRandomStream& RandStream) const
+{
+	static const TArray<FName> NoExcludedBlockNames;
+	int32 NumCandidates = 0;
+	for (int32 Index = 0; Index < Num(); Index++)
+	{
+		if (IsAllowed(Index, NoExcludedBlockNames, ForbiddenBlockNames, bPreventImmobile)) {
+			NumCandidates++;
+		}
+	}
+	if (NumCandidates <= 0) {
+		return NAME_None;
+	}
+	int32 Remaining = RandStream.RandHelper(NumCandidates);
+	for (int32 Index = 0; Index < Num(); Index++)
+	{
+		if (!IsAllowed(Index, NoExcludedBlockNames, ForbiddenBlockNames, bPreventImmobile)) {
+			continue;
+		}
+		if (Remaining-- == 0) {
+			return BlockTypeNames[Index];
+		}
+	}
+	return NAME_None;
+}
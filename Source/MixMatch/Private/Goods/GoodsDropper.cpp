@@ -2,7 +2,8 @@
 
 #include "Goods/GoodsDropper.h"
 #include "Goods/GoodsFunctionLibrary.h"
-//#include "MixMatch.h"
+#include "MixMatch/MixMatch.h"
+#include "Algo/BinarySearch.h"
 
 /*
 */
@@ -29,7 +30,12 @@ bool UGoodsDropper::AddDropTableDataToLibrary(UDataTable* GoodsDropSetsData)
 		if (FirstTable == nullptr) {
 			return false;
 		}
-		DropTableLibrary.AddUnique(GoodsDropSetsData);
+		if (!DropTableLibrary.Contains(GoodsDropSetsData))
+		{
+			DropTableLibrary.Add(GoodsDropSetsData);
+			GoodsDropSetsData->OnDataTableChanged().AddUObject(this, &UGoodsDropper::OnDropTableChanged);
+		}
+		bDropSetsCompiled = false;
 	}
 	return true;
 }
@@ -39,6 +45,11 @@ bool UGoodsDropper::AddDropTableDataToLibrary(UDataTable* GoodsDropSetsData)
 bool UGoodsDropper::RemoveDropTableDataFromLibrary(UDataTable * GoodsDropSetsData)
 {
 	int32 NumRemoved = DropTableLibrary.Remove(GoodsDropSetsData);
+	if (NumRemoved > 0)
+	{
+		GoodsDropSetsData->OnDataTableChanged().RemoveAll(this);
+		bDropSetsCompiled = false;
+	}
 	return NumRemoved > 0;
 }
 
@@ -46,7 +57,14 @@ bool UGoodsDropper::RemoveDropTableDataFromLibrary(UDataTable * GoodsDropSetsDat
 */
 void UGoodsDropper::ClearDropTableLibrary()
 {
+	for (UDataTable* Table : DropTableLibrary)
+	{
+		if (IsValid(Table)) {
+			Table->OnDataTableChanged().RemoveAll(this);
+		}
+	}
 	DropTableLibrary.Empty();
+	bDropSetsCompiled = false;
 }
 
 /*
@@ -56,6 +74,15 @@ void UGoodsDropper::SeedRandomStream(const int32 NewSeed)
 	RandStream.Initialize(NewSeed);
 }
 
+/*
+*/
+FRandomStream* UGoodsDropper::SetRandomStreamOverride(FRandomStream* NewStream)
+{
+	FRandomStream* PreviousStream = RandStreamOverride;
+	RandStreamOverride = NewStream;
+	return PreviousStream;
+}
+
 /*
 */
 TArray<FGoodsQuantity> UGoodsDropper::EvaluateGoodsDropSet(const FGoodsDropSet& GoodsSet, const float QuantityScale)
@@ -65,7 +92,7 @@ TArray<FGoodsQuantity> UGoodsDropper::EvaluateGoodsDropSet(const FGoodsDropSet&
 	if (GoodsSet.bAsWeightedList)
 	{
 		// Make a number of picks
-		TotalPicks = RandStream.RandRange(GoodsSet.MinWeightedPicks, GoodsSet.MaxWeightedPicks);
+		TotalPicks = GetRandStream().RandRange(GoodsSet.MinWeightedPicks, GoodsSet.MaxWeightedPicks);
 		// Each pick is one item from the weighted list of items.
 		for (int i = 1; i <= TotalPicks; i++)
 		{
@@ -89,15 +116,14 @@ TArray<FGoodsQuantity> UGoodsDropper::EvaluateGoodsDropSet(const FGoodsDropSet&
 TArray<FGoodsQuantity> UGoodsDropper::EvaluateGoodsDropSetByName(const FName & DropSetName, const float QuantityScale)
 {
 	TArray<FGoodsQuantity> AllGoods;
-	const FGoodsDropSet* FoundDropSet = FindDropSetInLibrary(DropSetName);
+	const int32 DropSetIndex = FindCompiledDropSet(DropSetName);
 
-	if (FoundDropSet != nullptr)
+	if (DropSetIndex != INDEX_NONE)
 	{
-		AllGoods = EvaluateGoodsDropSet(*FoundDropSet, QuantityScale);
+		EvaluateCompiledDropSet(DropSetIndex, QuantityScale, AllGoods);
 	}
 	else
 	{
-		AllGoods = TArray<FGoodsQuantity>();
 		// TODO: report missed drop table hit
 	}
 	return AllGoods;
@@ -105,18 +131,162 @@ TArray<FGoodsQuantity> UGoodsDropper::EvaluateGoodsDropSetByName(const FName & D
 
 /*
 */
-const FGoodsDropSet* UGoodsDropper::FindDropSetInLibrary(const FName DropSetName) const
+void UGoodsDropper::CompileDropSets()
 {
-	FGoodsDropSet* FoundDropSet = nullptr;
+	CompiledDropSets.Reset();
+	CompiledDropChances.Reset();
+	CompiledDropSetIndexes.Reset();
+	bDropSetsCompiled = true;
 
-	// Look in each data table until we find one containing a row with the given name. Then return that row.
+	// The first table containing a row with a given name supplies that drop set.
 	for (UDataTable* Table : DropTableLibrary)
 	{
-		FoundDropSet = Table->FindRow<FGoodsDropSet>(DropSetName, "", false);
-		// If we found the table, stop looking through library
-		if (FoundDropSet != nullptr) { break; }
+		if (!IsValid(Table)) { continue; }
+		for (const TPair<FName, uint8*>& Row : Table->GetRowMap())
+		{
+			if (CompiledDropSetIndexes.Contains(Row.Key)) { continue; }
+			FCompiledGoodsDropSet& Compiled = CompiledDropSets.AddDefaulted_GetRef();
+			Compiled.DropSet = reinterpret_cast<const FGoodsDropSet*>(Row.Value);
+			CompiledDropSetIndexes.Add(Row.Key, CompiledDropSets.Num() - 1);
+		}
+	}
+
+	// Resolve other goods drops now that all drop sets have an index.
+	for (FCompiledGoodsDropSet& Compiled : CompiledDropSets)
+	{
+		const TArray<FGoodsDropChance>& GoodsChances = Compiled.DropSet->GoodsChances;
+		Compiled.FirstChance = CompiledDropChances.Num();
+		Compiled.NumChances = GoodsChances.Num();
+		for (const FGoodsDropChance& DropChance : GoodsChances)
+		{
+			FCompiledGoodsDropChance& CompiledChance = CompiledDropChances.AddDefaulted_GetRef();
+			CompiledChance.DropChance = &DropChance;
+			for (const FName& DropSetName : DropChance.OtherGoodsDrops)
+			{
+				const int32* OtherIndex = CompiledDropSetIndexes.Find(DropSetName);
+				if (OtherIndex) {
+					CompiledChance.OtherDropSets.Add(*OtherIndex);
+				}
+				else {
+					UE_LOG(LogMMGame, Warning, TEXT("GoodsDropper::CompileDropSets - Drop set %s references drop set %s, which was not found."), *Compiled.DropSet->Name.ToString(), *DropSetName.ToString());
+				}
+			}
+		}
+		if (Compiled.DropSet->bAsWeightedList)
+		{
+			// Summed in the same order as EvaluateGoodsDropChanceWeighted, so a pick gives the same result from the same random number.
+			// Negative chances still count toward the total weight, so they add a chance of dropping nothing.
+			float AccumWeight = 0.0f;
+			for (int32 i = 0; i < GoodsChances.Num(); i++)
+			{
+				Compiled.TotalWeight += FMath::Abs<float>(GoodsChances[i].Chance);
+				if (GoodsChances[i].Chance > 0.0f)
+				{
+					AccumWeight += GoodsChances[i].Chance;
+					Compiled.CumulativeWeights.Add(AccumWeight);
+					Compiled.CumulativeChances.Add(Compiled.FirstChance + i);
+				}
+			}
+		}
+	}
+
+	TArray<uint8> VisitState;
+	VisitState.SetNumZeroed(CompiledDropSets.Num());
+	for (int32 DropSetIndex = 0; DropSetIndex < CompiledDropSets.Num(); DropSetIndex++)
+	{
+		if (VisitState[DropSetIndex] == 0) {
+			BreakDropSetCycles(DropSetIndex, VisitState);
+		}
+	}
+}
+
+/*
+*/
+void UGoodsDropper::BreakDropSetCycles(const int32 DropSetIndex, TArray<uint8>& VisitState)
+{
+	VisitState[DropSetIndex] = 1;
+	const FCompiledGoodsDropSet& Compiled = CompiledDropSets[DropSetIndex];
+	for (int32 ChanceIndex = Compiled.FirstChance; ChanceIndex < Compiled.FirstChance + Compiled.NumChances; ChanceIndex++)
+	{
+		TArray<int32>& OtherDropSets = CompiledDropChances[ChanceIndex].OtherDropSets;
+		for (int32 i = OtherDropSets.Num() - 1; i >= 0; i--)
+		{
+			const int32 OtherIndex = OtherDropSets[i];
+			if (VisitState[OtherIndex] == 1)
+			{
+				UE_LOG(LogMMGame, Error, TEXT("GoodsDropper::CompileDropSets - Drop set %s references drop set %s, which leads back to it. Ignoring the reference."), 
+					*Compiled.DropSet->Name.ToString(), *CompiledDropSets[OtherIndex].DropSet->Name.ToString());
+				OtherDropSets.RemoveAt(i);
+			}
+			else if (VisitState[OtherIndex] == 0) {
+				BreakDropSetCycles(OtherIndex, VisitState);
+			}
+		}
+	}
+	VisitState[DropSetIndex] = 2;
+}
+
+/*
+*/
+int32 UGoodsDropper::FindCompiledDropSet(const FName DropSetName)
+{
+	if (!bDropSetsCompiled) {
+		CompileDropSets();
+	}
+	const int32* DropSetIndex = CompiledDropSetIndexes.Find(DropSetName);
+	return DropSetIndex ? *DropSetIndex : INDEX_NONE;
+}
+
+/*
+*/
+void UGoodsDropper::OnDropTableChanged()
+{
+	bDropSetsCompiled = false;
+}
+
+/*
+*/
+void UGoodsDropper::EvaluateCompiledDropSet(const int32 DropSetIndex, const float QuantityScale, TArray<FGoodsQuantity>& OutGoods)
+{
+	const FCompiledGoodsDropSet& Compiled = CompiledDropSets[DropSetIndex];
+	if (Compiled.DropSet->bAsWeightedList)
+	{
+		// Make a number of picks, each one item from the weighted list of items.
+		const int32 TotalPicks = GetRandStream().RandRange(Compiled.DropSet->MinWeightedPicks, Compiled.DropSet->MaxWeightedPicks);
+		for (int i = 1; i <= TotalPicks && Compiled.TotalWeight > 0.0f; i++)
+		{
+			// One random number per pick, the same as EvaluateGoodsDropChanceWeighted, so seeded drops are unchanged.
+			const float Pick = GetRandStream().FRandRange(0.0f, Compiled.TotalWeight);
+			const int32 Picked = Algo::LowerBound(Compiled.CumulativeWeights, Pick);
+			// A pick past the last positive chance landed on the weight of the negative chances, which drops nothing.
+			if (Picked < Compiled.CumulativeWeights.Num()) {
+				GoodsForCompiledDropChance(CompiledDropChances[Compiled.CumulativeChances[Picked]], QuantityScale, OutGoods);
+			}
+		}
+	}
+	else
+	{
+		// Each entry has a percent chance to be included.
+		for (int32 ChanceIndex = Compiled.FirstChance; ChanceIndex < Compiled.FirstChance + Compiled.NumChances; ChanceIndex++)
+		{
+			const FCompiledGoodsDropChance& CompiledChance = CompiledDropChances[ChanceIndex];
+			if (CompiledChance.DropChance->Chance > 0.0f && GetRandStream().FRandRange(0.0f, 1.0f) <= CompiledChance.DropChance->Chance) {
+				GoodsForCompiledDropChance(CompiledChance, QuantityScale, OutGoods);
+			}
+		}
+	}
+}
+
+/*
+*/
+void UGoodsDropper::GoodsForCompiledDropChance(const FCompiledGoodsDropChance& CompiledChance, const float QuantityScale, TArray<FGoodsQuantity>& OutGoods)
+{
+	if (CompiledChance.DropChance->GoodsQuantities.Num() > 0) {
+		OutGoods.Append(UGoodsFunctionLibrary::GoodsQuantitiesFromRanges(GetRandStream(), CompiledChance.DropChance->GoodsQuantities, QuantityScale));
+	}
+	for (const int32 OtherIndex : CompiledChance.OtherDropSets) {
+		EvaluateCompiledDropSet(OtherIndex, QuantityScale, OutGoods);
 	}
-	return FoundDropSet;
 }
 
 /*
@@ -133,7 +303,7 @@ TArray<FGoodsQuantity> UGoodsDropper::EvaluateGoodsDropChanceWeighted(const TArr
 		TotalWeight += FMath::Abs<float>(DropChance.Chance);
 	}
 	if (TotalWeight <= 0.0f) { return AllGoods; }
-	Pick = RandStream.FRandRange(0.0f, TotalWeight);
+	Pick = GetRandStream().FRandRange(0.0f, TotalWeight);
 	for (const FGoodsDropChance& DropChance : DropChances)
 	{
 		if (DropChance.Chance <= 0.0f) { continue; }
@@ -154,7 +324,7 @@ TArray<FGoodsQuantity> UGoodsDropper::EvaluateGoodsDropChancePercent(const FGood
 	TArray<FGoodsQuantity> AllGoods;
 	if (DropChance.Chance <= 0.0f) { return AllGoods; }
 	// Determine if this drop chance evaluates to a successful drop
-	if (RandStream.FRandRange(0.0f, 1.0f) <= DropChance.Chance)
+	if (GetRandStream().FRandRange(0.0f, 1.0f) <= DropChance.Chance)
 	{
 		AllGoods = GoodsForDropChance(DropChance, QuantityScale);
 	}
@@ -171,16 +341,16 @@ TArray<FGoodsQuantity> UGoodsDropper::GoodsForDropChance(const FGoodsDropChance
 	if (DropChance.GoodsQuantities.Num() > 0)
 	{
 		// Evaluate all GoodsQuantities and add them to our collection
-		AllGoods.Append(UGoodsFunctionLibrary::GoodsQuantitiesFromRanges(RandStream, DropChance.GoodsQuantities, QuantityScale));
+		AllGoods.Append(UGoodsFunctionLibrary::GoodsQuantitiesFromRanges(GetRandStream(), DropChance.GoodsQuantities, QuantityScale));
 	}
 	
 	// Evaluate any other GoodsDropSets and add them to our collection (if any)
 	for (const FName& DropSetName : DropChance.OtherGoodsDrops)
 	{
-		// Find drop set in library
-		const FGoodsDropSet* DropSet = FindDropSetInLibrary(DropSetName);
-		if (DropSet) {
-			AllGoods.Append(EvaluateGoodsDropSet(*DropSet, QuantityScale));
+		// Find drop set in library. Compiled drop sets have no reference cycles, so this cannot recurse without end.
+		const int32 DropSetIndex = FindCompiledDropSet(DropSetName);
+		if (DropSetIndex != INDEX_NONE) {
+			EvaluateCompiledDropSet(DropSetIndex, QuantityScale, AllGoods);
 		}
 	}
 	return AllGoods;
@@ -9,9 +9,8 @@ UInventoryActorComponent::UInventoryActorComponent()
 {
 	//SetIsReplicated(false);
 	SetIsReplicatedByDefault(false);
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
-	PrimaryComponentTick.bCanEverTick = true;
+	// Inventory changes are all event driven, so this component never ticks.
+	PrimaryComponentTick.bCanEverTick = false;
 
 	// ...
 }
@@ -56,15 +55,6 @@ bool UInventoryActorComponent::ShouldUpdateClient()
 }
 
 
-// Called every frame
-void UInventoryActorComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
-{
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
-
-	// ...
-}
-
-
 bool UInventoryActorComponent::AddSubtractGoods(const FGoodsQuantity& GoodsDelta, const bool bNegateGoodsQuantities, float& CurrentQuantity, const bool bAddToSnapshot)
 {
 	FGoodsQuantity GoodsQuantity;
@@ -0,0 +1,87 @@
+#include "MMAliasTable.h"
+
+
+void FMMAliasTable::Build(const TArray<float>& Weights)
+{
+	Reset();
+	const int32 NumEntries = Weights.Num();
+	for (const float Weight : Weights)
+	{
+		if (Weight > 0.f) {
+			TotalWeight += Weight;
+		}
+	}
+	if (TotalWeight <= 0.f) {
+		return;
+	}
+	Probability.SetNumUninitialized(NumEntries);
+	Alias.SetNumUninitialized(NumEntries);
+	// Scale weights so the average is 1, then pair each under-full column with an over-full one.
+	TArray<float> Scaled;
+	TArray<int32> Small;
+	TArray<int32> Large;
+	Scaled.SetNumUninitialized(NumEntries);
+	Small.Reserve(NumEntries);
+	Large.Reserve(NumEntries);
+	for (int32 Index = 0; Index < NumEntries; Index++)
+	{
+		Scaled[Index] = (FMath::Max(Weights[Index], 0.f) * NumEntries) / TotalWeight;
+		if (Scaled[Index] < 1.f) {
+			Small.Add(Index);
+		}
+		else {
+			Large.Add(Index);
+		}
+	}
+	while (Small.Num() > 0 && Large.Num() > 0)
+	{
+		const int32 SmallIndex = Small.Pop(false);
+		const int32 LargeIndex = Large.Pop(false);
+		Probability[SmallIndex] = Scaled[SmallIndex];
+		Alias[SmallIndex] = LargeIndex;
+		Scaled[LargeIndex] = (Scaled[LargeIndex] + Scaled[SmallIndex]) - 1.f;
+		if (Scaled[LargeIndex] < 1.f) {
+			Small.Add(LargeIndex);
+		}
+		else {
+			Large.Add(LargeIndex);
+		}
+	}
+	// Whatever is left is full, give or take float rounding.
+	// An entry with no weight must never be picked, so point it at any entry that can be.
+	int32 PositiveIndex = INDEX_NONE;
+	for (int32 Index = 0; Index < NumEntries && PositiveIndex == INDEX_NONE; Index++)
+	{
+		if (Weights[Index] > 0.f) {
+			PositiveIndex = Index;
+		}
+	}
+	for (const int32 Index : Large)
+	{
+		Probability[Index] = Weights[Index] > 0.f ? 1.f : 0.f;
+		Alias[Index] = Weights[Index] > 0.f ? Index : PositiveIndex;
+	}
+	for (const int32 Index : Small)
+	{
+		Probability[Index] = Weights[Index] > 0.f ? 1.f : 0.f;
+		Alias[Index] = Weights[Index] > 0.f ? Index : PositiveIndex;
+	}
+}
+
+
+void FMMAliasTable::Reset()
+{
+	Probability.Reset();
+	Alias.Reset();
+	TotalWeight = 0.f;
+}
+
+
+int32 FMMAliasTable::Sample(FRandomStream& RandStream) const
+{
+	if (!CanSample()) {
+		return INDEX_NONE;
+	}
+	const int32 Column = RandStream.RandHelper(Probability.Num());
+	return RandStream.FRand() < Probability[Column] ? Column : Alias[Column];
+}
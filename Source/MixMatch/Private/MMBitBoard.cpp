@@ -0,0 +1,220 @@
+#include "MMBitBoard.h"
+
+
+FMMBitBoard::FMMBitBoard()
+{
+	SizeX = 0;
+}
+
+
+FMMBitBoard::FMMBitBoard(const int32 InSizeX, const int32 InSizeY)
+{
+	Init(InSizeX, InSizeY);
+}
+
+
+void FMMBitBoard::Init(const int32 InSizeX, const int32 InSizeY)
+{
+	check(InSizeX <= MaxSizeX);
+	SizeX = FMath::Clamp(InSizeX, 0, MaxSizeX);
+	Rows.Init(0, FMath::Max(InSizeY, 0));
+}
+
+
+void FMMBitBoard::Reset()
+{
+	for (uint64& Row : Rows) {
+		Row = 0;
+	}
+}
+
+
+bool FMMBitBoard::IsEmpty() const
+{
+	for (const uint64 Row : Rows)
+	{
+		if (Row != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+int32 FMMBitBoard::Num() const
+{
+	int32 Count = 0;
+	for (const uint64 Row : Rows) {
+		Count += FPlatformMath::CountBits(Row);
+	}
+	return Count;
+}
+
+
+void FMMBitBoard::SetLine(const FIntPoint& StartCoords, const EMMOrientation Orientation, const int32 Length)
+{
+	if (Length <= 0) {
+		return;
+	}
+	if (Orientation == EMMOrientation::Horizontal)
+	{
+		if (!Rows.IsValidIndex(StartCoords.Y)) {
+			return;
+		}
+		const uint64 LineBits = Length >= 64 ? ~0ULL : (1ULL << Length) - 1ULL;
+		Rows[StartCoords.Y] |= (LineBits << StartCoords.X) & RowMask();
+	}
+	else
+	{
+		const int32 EndY = FMath::Min(StartCoords.Y + Length, Rows.Num());
+		for (int32 Y = FMath::Max(StartCoords.Y, 0); Y < EndY; Y++) {
+			Rows[Y] |= 1ULL << StartCoords.X;
+		}
+	}
+}
+
+
+FMMBitBoard FMMBitBoard::Shifted(const EMMDirection Direction) const
+{
+	FMMBitBoard Result(SizeX, Rows.Num());
+	const int32 SizeY = Rows.Num();
+	const uint64 Mask = RowMask();
+	// Offsets match UMMMath::DirectionToOffset. North is increasing Y, East is increasing X.
+	const int32 OffsetX = (Direction == EMMDirection::East || Direction == EMMDirection::NorthEast || Direction == EMMDirection::SouthEast) ? 1 :
+		((Direction == EMMDirection::West || Direction == EMMDirection::NorthWest || Direction == EMMDirection::SouthWest) ? -1 : 0);
+	const int32 OffsetY = (Direction == EMMDirection::North || Direction == EMMDirection::NorthEast || Direction == EMMDirection::NorthWest) ? 1 :
+		((Direction == EMMDirection::South || Direction == EMMDirection::SouthEast || Direction == EMMDirection::SouthWest) ? -1 : 0);
+	for (int32 Y = 0; Y < SizeY; Y++)
+	{
+		const int32 FromY = Y - OffsetY;
+		if (FromY < 0 || FromY >= SizeY) {
+			continue;
+		}
+		const uint64 Row = Rows[FromY];
+		Result.Rows[Y] = (OffsetX > 0 ? (Row << 1) : (OffsetX < 0 ? (Row >> 1) : Row)) & Mask;
+	}
+	return Result;
+}
+
+
+FMMBitBoard FMMBitBoard::Dilated(const bool bIncludeDiagonal) const
+{
+	FMMBitBoard Result(SizeX, Rows.Num());
+	const int32 SizeY = Rows.Num();
+	const uint64 Mask = RowMask();
+	for (int32 Y = 0; Y < SizeY; Y++)
+	{
+		const uint64 Row = Rows[Y];
+		const uint64 Below = Y > 0 ? Rows[Y - 1] : 0;
+		const uint64 Above = Y < SizeY - 1 ? Rows[Y + 1] : 0;
+		// Spread each row East and West, then spread those rows (or the plain rows for orthogonal only) North and South.
+		const uint64 RowSpread = Row | (Row << 1) | (Row >> 1);
+		const uint64 Vertical = bIncludeDiagonal ? (Below | (Below << 1) | (Below >> 1) | Above | (Above << 1) | (Above >> 1)) : (Below | Above);
+		Result.Rows[Y] = (RowSpread | Vertical) & Mask;
+	}
+	return Result;
+}
+
+
+FMMBitBoard FMMBitBoard::Neighbors(const bool bIncludeDiagonal) const
+{
+	return Dilated(bIncludeDiagonal) & ~(*this);
+}
+
+
+FMMBitBoard FMMBitBoard::RunStarts(const int32 Length, const EMMOrientation Orientation) const
+{
+	FMMBitBoard Result(*this);
+	const int32 SizeY = Rows.Num();
+	if (Length <= 1) {
+		return Result;
+	}
+	if (Orientation == EMMOrientation::Horizontal)
+	{
+		// A bit survives if the next Length - 1 bits to the East are also set.
+		for (int32 Y = 0; Y < SizeY; Y++)
+		{
+			uint64 Row = Rows[Y];
+			for (int32 i = 1; i < Length && Row != 0; i++) {
+				Row &= Rows[Y] >> i;
+			}
+			Result.Rows[Y] = Row;
+		}
+	}
+	else
+	{
+		// A bit survives if the bits in the next Length - 1 rows to the North are also set.
+		for (int32 Y = 0; Y < SizeY; Y++)
+		{
+			uint64 Row = Y + Length <= SizeY ? Rows[Y] : 0;
+			for (int32 i = 1; i < Length && Row != 0; i++) {
+				Row &= Rows[Y + i];
+			}
+			Result.Rows[Y] = Row;
+		}
+	}
+	return Result;
+}
+
+
+void FMMBitBoard::GetSetCoords(TArray<FIntPoint>& OutCoords) const
+{
+	for (int32 Y = 0; Y < Rows.Num(); Y++)
+	{
+		uint64 Row = Rows[Y];
+		while (Row != 0)
+		{
+			const int32 X = (int32)FPlatformMath::CountTrailingZeros64(Row);
+			OutCoords.Add(FIntPoint(X, Y));
+			// Clear lowest set bit
+			Row &= Row - 1;
+		}
+	}
+}
+
+
+FMMBitBoard FMMBitBoard::operator&(const FMMBitBoard& Other) const
+{
+	FMMBitBoard Result(*this);
+	Result &= Other;
+	return Result;
+}
+
+
+FMMBitBoard FMMBitBoard::operator|(const FMMBitBoard& Other) const
+{
+	FMMBitBoard Result(*this);
+	Result |= Other;
+	return Result;
+}
+
+
+FMMBitBoard FMMBitBoard::operator~() const
+{
+	FMMBitBoard Result(SizeX, Rows.Num());
+	const uint64 Mask = RowMask();
+	for (int32 Y = 0; Y < Rows.Num(); Y++) {
+		Result.Rows[Y] = ~Rows[Y] & Mask;
+	}
+	return Result;
+}
+
+
+FMMBitBoard& FMMBitBoard::operator&=(const FMMBitBoard& Other)
+{
+	check(Other.Rows.Num() == Rows.Num());
+	for (int32 Y = 0; Y < Rows.Num(); Y++) {
+		Rows[Y] &= Other.Rows[Y];
+	}
+	return *this;
+}
+
+
+FMMBitBoard& FMMBitBoard::operator|=(const FMMBitBoard& Other)
+{
+	check(Other.Rows.Num() == Rows.Num());
+	for (int32 Y = 0; Y < Rows.Num(); Y++) {
+		Rows[Y] |= Other.Rows[Y];
+	}
+	return *this;
+}
@@ -3,7 +3,10 @@
 #include "MMBlock.h"
 #include "UObject/ConstructorHelpers.h"
 #include "Components/StaticMeshComponent.h"
+#include "Components/InstancedStaticMeshComponent.h"
 #include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "TimerManager.h"
 #include "Kismet/GameplayStatics.h"
 #include "..\MixMatch.h"
 #include "MMEnums.h"
@@ -31,8 +34,9 @@ AMMBlock::AMMBlock()
 	};
 	static FConstructorStatics ConstructorStatics;
 
+	// Blocks are moved and matched by their grid's tick. Subclasses can still turn on the actor tick for their own use.
 	PrimaryActorTick.bCanEverTick = true;
-	PrimaryActorTick.bStartWithTickEnabled = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
 
 	// Set defaults
 	BaseMaterial = ConstructorStatics.BaseMaterial.Get();
@@ -68,49 +72,14 @@ void AMMBlock::OnConstruction(const FTransform& Transform)
 }
 
 
-void AMMBlock::Tick(float DeltaSeconds)
-{
-	Super::Tick(DeltaSeconds);
-	switch (BlockState) {
-		case EMMGridState::Moving :
-			MoveTick(DeltaSeconds);
-			break;
-		case EMMGridState::Matching :
-			MatchTick(DeltaSeconds);
-			break;
-		case EMMGridState::Settling :
-			// Grid processes settle ticks
-			//SettleTick(DeltaSeconds);
-			break;
-	}
-}
-
-
 bool AMMBlock::MoveTick_Implementation(float DeltaSeconds)
 {
 	// Do movement
 	if (bMoveSuccessful) {
-		float TargetDistance = DistanceToCell();
 		// Check if we're done settling/moving
-		if (TargetDistance <= 1.f)
-		{
-			SetActorRelativeLocation(Cell()->GetBlockLocalLocation());
+		if (UpdateMovement()) {
 			MoveFinished();
 		}
-		else
-		{
-			float MoveSpeed = 100;
-			AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
-			if (GameMode) {
-				MoveSpeed = GameMode->GetBlockMoveSpeed();
-			}
-			if (IsValid(MoveCurve)) {
-				MoveSpeed = MoveSpeed * MoveCurve->GetFloatValue(PercentMoveComplete());
-			}
-			FVector DirVector = Cell()->GetBlockLocalLocation() - GetRelativeLocation();
-			DirVector.Normalize(.002);
-			SetActorRelativeLocation(GetRelativeLocation() + (FMath::Min(MoveSpeed * DeltaSeconds, TargetDistance) * DirVector));
-		}
 	}
 	else {
 		MoveFinished();
@@ -124,10 +93,12 @@ bool AMMBlock::MatchTick_Implementation(float DeltaSeconds)
 	// Base class does nothing but call MatchFinished on all current matches.
 	if (CurrentMatches.Num() > 0) 
 	{
-		TArray<UBlockMatch*> MatchesToFinish;
-		MatchesToFinish.Append(CurrentMatches);
-		for (UBlockMatch* CurMatch : MatchesToFinish) {
-			MatchFinished(CurMatch);
+		// Iterate backwards since MatchFinished removes the match from CurrentMatches.
+		for (int32 i = CurrentMatches.Num() - 1; i >= 0; i--) 
+		{
+			if (CurrentMatches.IsValidIndex(i)) {
+				MatchFinished(CurrentMatches[i]);
+			}
 		}
 	}
 	else {
@@ -140,9 +111,13 @@ bool AMMBlock::MatchTick_Implementation(float DeltaSeconds)
 bool AMMBlock::SettleTick_Implementation(float DeltaSeconds)
 {
 	// Do settling movement
-	float TargetDistance = DistanceToCell();
 	if (bMoveSuccessful) 
 	{
+		// The grid can give this block a lower cell while it is settling. See AMMPlayGrid::PlanColumnSettle
+		if (!MoveEndLocation.Equals(Cell()->GetBlockLocalLocation())) {
+			ExtendMovement();
+		}
+		bool bMovementDone = UpdateMovement();
 		if (bFallingIntoGrid)
 		{
 			AMMPlayGridCell* TopCell = Grid()->GetTopCell(Cell()->X);
@@ -158,20 +133,8 @@ bool AMMBlock::SettleTick_Implementation(float DeltaSeconds)
 				Grid()->BlocksFallingIntoGrid[GetCoords().X].Blocks.RemoveSingle(this);
 			}
 		}
-		// Check if we're done settling/moving
-		if (TargetDistance <= 1.0f)
-		{
-			// Re-check our settle location
-			AMMPlayGridCell* SettleCell = FindSettleCell();
-			if (SettleCell != nullptr && SettleCell != OwningGridCell)
-			{
-				ChangeOwningGridCell(SettleCell);
-				TargetDistance = DistanceToCell();
-				StartMoveDistance += TargetDistance;
-			}
-		}
-		// If we are still near our settle target, finsh settle movement
-		if (TargetDistance <= 1.f)
+		// If we reached our settle target, finsh settle movement
+		if (bMovementDone)
 		{
 			SetActorRelativeLocation(Cell()->GetBlockLocalLocation());
 			if (SettleToGridCell) 
@@ -187,20 +150,6 @@ bool AMMBlock::SettleTick_Implementation(float DeltaSeconds)
 				SettleFinished();
 			}
 		}
-		else
-		{
-			float MoveSpeed = 100.f;
-			AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
-			if (GameMode) {
-				MoveSpeed = GameMode->GetBlockMoveSpeed();
-			}
-			if (IsValid(MoveCurve)) {
-				MoveSpeed = MoveSpeed * MoveCurve->GetFloatValue(PercentMoveComplete());
-			}
-			FVector DirVector = Cell()->GetBlockLocalLocation() - GetRelativeLocation();
-			DirVector.Normalize(.002);
-			SetActorRelativeLocation(GetRelativeLocation() + (FMath::Min(MoveSpeed * DeltaSeconds, TargetDistance) * DirVector));
-		}
 		// Sanity check. Shouldn't be needed....
 		if (BlockSettleFails >= 1)
 		{
@@ -218,18 +167,63 @@ bool AMMBlock::SettleTick_Implementation(float DeltaSeconds)
 }
 
 
+void AMMBlock::BeginMovement()
+{
+	MoveStartLocation = GetRelativeLocation();
+	MoveStartTime = GetWorld()->GetTimeSeconds();
+	ExtendMovement();
+}
+
+
+void AMMBlock::ExtendMovement()
+{
+	MoveEndLocation = Cell()->GetBlockLocalLocation();
+	StartMoveDistance = FVector::Distance(MoveStartLocation, MoveEndLocation);
+}
+
+
+bool AMMBlock::UpdateMovement()
+{
+	const float Alpha = Grid()->GetMoveAlpha(IsValid(MoveCurve) ? MoveCurve : nullptr, StartMoveDistance, GetWorld()->GetTimeSeconds() - MoveStartTime);
+	SetActorRelativeLocation(FMath::Lerp(MoveStartLocation, MoveEndLocation, Alpha));
+	return Alpha >= 1.f;
+}
+
+
 void AMMBlock::SetBlockType_Implementation(const FBlockType& NewBlockType)
 {
-	BlockType = NewBlockType;
-	CurrentHealth = BlockType.BaseHealth;
-	SetCanBeDamaged(BlockType.bTakesDamage);
+	AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
+	if (GameMode) 
+	{
+		BlockTypeRegistry = &GameMode->GetBlockTypeRegistry();
+		BlockTypeId = BlockTypeRegistry->GetTypeId(NewBlockType.Name);
+	}
+	else 
+	{
+		BlockTypeRegistry = nullptr;
+		BlockTypeId = FBlockTypeRegistry::InvalidId;
+	}
+	UE_CLOG(BlockTypeId == FBlockTypeRegistry::InvalidId, LogMMGame, Error, TEXT("MMBlock::SetBlockType - Block type %s is not registered. Using the given block type data."), *NewBlockType.Name.ToString());
+	// Registered types are only read from the registry. Don't keep a copy of them on every block.
+	if (BlockTypeId == FBlockTypeRegistry::InvalidId) {
+		BlockType = NewBlockType;
+	}
+	else if (!BlockType.Name.IsNone()) {
+		BlockType = FBlockType();
+	}
+	CurrentHealth = GetBlockType().BaseHealth;
+	SetCanBeDamaged(GetBlockType().bTakesDamage);
 	UpdateBlockVis();
+	if (Grid()) {
+		Grid()->SyncBoardBlock(this);
+	}
 }
 
 
 const FBlockType& AMMBlock::GetBlockType() const
 {
-	return BlockType;
+	const FBlockType* RegisteredType = BlockTypeRegistry ? BlockTypeRegistry->GetType(BlockTypeId) : nullptr;
+	return RegisteredType ? *RegisteredType : BlockType;
 }
 
 
@@ -271,7 +265,11 @@ bool AMMBlock::Matches(const AMMBlock* OtherBlock)
 {
 	if (OtherBlock == nullptr) { return false; }
 	//UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("Block::Matches %s == %s  %s"), *BlockType.MatchCode.ToString(), *OtherBlock->BlockType.MatchCode.ToString(), BlockType == OtherBlock->BlockType ? TEXT("True") : TEXT("False"));
-	return BlockType == OtherBlock->BlockType;
+	// Use the precomputed compatibility matrix when both blocks have registered types.
+	if (BlockTypeRegistry && BlockTypeRegistry->IsValidId(BlockTypeId) && BlockTypeRegistry->IsValidId(OtherBlock->BlockTypeId)) {
+		return BlockTypeRegistry->Matches(BlockTypeId, OtherBlock->BlockTypeId);
+	}
+	return GetBlockType() == OtherBlock->GetBlockType();
 }
 
 
@@ -289,43 +287,13 @@ bool AMMBlock::IsMatchFinished(const UBlockMatch* Match) const
 
 bool AMMBlock::CanMove() const
 {
-	return !BlockType.bImmobile;
+	return !GetBlockType().bImmobile;
 }
 
 
 bool AMMBlock::IsIndestructible() const
 {
-	return BlockType.bIndestructible;
-}
-
-
-AMMPlayGridCell* AMMBlock::FindSettleCell()
-{
-	// Determine where to settle to
-	if (Grid())
-	{
-		if (bFallingIntoGrid)
-		{
-			// Always try to settle to cell directly below current cell
-			AMMPlayGridCell* NextCell = Grid()->GetCell(GetCoords() + FIntPoint(0, -1));
-			if (NextCell && !IsValid(NextCell->CurrentBlock)) {
-				return NextCell;
-			}
-		}
-		else 
-		{
-			// Look at cells below this one until we find a cell that has a valid block below it.
-			AMMPlayGridCell* BelowCell = Grid()->GetCell(GetCoords() + FIntPoint(0, -1));
-			AMMPlayGridCell* NextCell = nullptr;
-			while (BelowCell && !IsValid(BelowCell->CurrentBlock))
-			{
-				NextCell = BelowCell;
-				BelowCell = Grid()->GetCell(BelowCell->GetCoords() + FIntPoint(0, -1));
-			}
-			return NextCell;
-		}
-	}	
-	return nullptr;
+	return GetBlockType().bIndestructible;
 }
 
 
@@ -358,7 +326,7 @@ bool AMMBlock::ChangeOwningGridCell(AMMPlayGridCell* ToCell)
 	else
 	{			
 		OwningGridCell = ToCell;
-		OwningGridCell->CurrentBlock = this;
+		OwningGridCell->SetCurrentBlock(this);
 		SettleToGridCell = nullptr;
 		if (OldCell) {
 			UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMBlock::ChangeOwningGridCell - Changing block %s at %s to cell %s"), *GetName(), *OldCell->GetCoords().ToString(), *GetCoords().ToString());
@@ -372,7 +340,7 @@ bool AMMBlock::ChangeOwningGridCell(AMMPlayGridCell* ToCell)
 	if (OldOwningCell && OldOwningCell != OwningGridCell && OldOwningCell->CurrentBlock == this)
 	{
 		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("                                 Block %s at %s cleared it's old cell %s"), *GetName(), *GetCoords().ToString(), *OldOwningCell->GetCoords().ToString());
-		OldOwningCell->CurrentBlock = nullptr;
+		OldOwningCell->SetCurrentBlock(nullptr);
 		Grid()->CellBecameOpen(OldOwningCell);
 	}
 	return bSuccess;
@@ -431,7 +399,7 @@ void AMMBlock::Highlight(bool bOn)
 void AMMBlock::DestroyBlock()
 {
 	if (OwningGridCell && OwningGridCell->CurrentBlock == this) {
-		OwningGridCell->CurrentBlock = nullptr;
+		OwningGridCell->SetCurrentBlock(nullptr);
 	}
 	BaseMatDynamic = nullptr;
 	AltMatDynamic = nullptr;
@@ -443,6 +411,65 @@ void AMMBlock::DestroyBlock()
 }
 
 
+void AMMBlock::DeactivateBlock()
+{
+	if (OwningGridCell && OwningGridCell->CurrentBlock == this) {
+		OwningGridCell->SetCurrentBlock(nullptr);
+	}
+	bWaitingToSettle = false;
+	OwningGridCell = nullptr;
+	SettleToGridCell = nullptr;
+	CurrentMatches.Reset();
+	BlockState = EMMGridState::Normal;
+	bPooled = true;
+	// Don't let timers and latent actions from this use of the block fire after it is reused.
+	GetWorldTimerManager().ClearAllTimersForObject(this);
+	if (GetWorld()) {
+		GetWorld()->GetLatentActionManager().RemoveActionsForObject(this);
+	}
+	SetActorTickEnabled(false);
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+	DetachFromActor(FDetachmentTransformRules::KeepRelativeTransform);
+	OnBlockPooled();
+}
+
+
+void AMMBlock::ActivateBlock()
+{
+	const AMMBlock* DefaultBlock = GetClass()->GetDefaultObject<AMMBlock>();
+	BlockState = EMMGridState::Normal;
+	bIsHighlighted = false;
+	bMovedByPlayer = false;
+	bMatchedHorizontal = false;
+	bMatchedVertical = false;
+	bUnsettled = false;
+	bFallingIntoGrid = false;
+	bMoveSuccessful = false;
+	StartMoveDistance = 0.f;
+	BlockSettleFails = 0;
+	bPooled = false;
+	// The grid may have scaled the mesh and matching turns off its collision. Blueprints may have changed its mesh, transform and materials.
+	if (GetBlockMesh() && DefaultBlock->GetBlockMesh()) 
+	{
+		UStaticMeshComponent* DefaultMesh = DefaultBlock->GetBlockMesh();
+		GetBlockMesh()->SetStaticMesh(DefaultMesh->GetStaticMesh());
+		GetBlockMesh()->SetRelativeTransform(DefaultMesh->GetRelativeTransform());
+		GetBlockMesh()->SetCollisionEnabled(DefaultMesh->GetCollisionEnabled());
+		GetBlockMesh()->EmptyOverrideMaterials();
+		for (int32 i = 0; i < DefaultMesh->OverrideMaterials.Num(); i++) 
+		{
+			if (DefaultMesh->OverrideMaterials[i]) {
+				GetBlockMesh()->SetMaterial(i, DefaultMesh->OverrideMaterials[i]);
+			}
+		}
+	}
+	SetActorEnableCollision(true);
+	SetActorHiddenInGame(false);
+	SetActorTickEnabled(DefaultBlock->PrimaryActorTick.bStartWithTickEnabled);
+}
+
+
 TArray<FGoodsQuantity> AMMBlock::GetBaseMatchGoods_Implementation(const UGoodsDropper* GoodsDropper, const float QuantityScale) const
 {
 	// const_cast because goods dropper must be passed as const in order to appear as input pin. GoodsDropper is not originally declared const.
@@ -458,13 +485,19 @@ TArray<FGoodsQuantity> AMMBlock::GetMatchGoods_Implementation(const UGoodsDroppe
 	// UPARAM(ref) does not work since UObjects must be passed as pointers.
 	UGoodsDropper* Dropper = const_cast<UGoodsDropper*>(GoodsDropper);
 	int32 BonusMatchSize = Match->Blocks.Num() - Grid()->GetMinimumMatchSize();
-	if (BonusMatchSize == 0 || GetBlockType().BonusMatchGoodsMultiplier == 0.f) {
-		return GetBaseMatchGoods(Dropper);
+	return ScaleMatchGoods(GetBaseMatchGoods(Dropper), GetBlockType(), BonusMatchSize);
+}
+
+
+TArray<FGoodsQuantity> AMMBlock::ScaleMatchGoods(const TArray<FGoodsQuantity>& BaseMatchGoods, const FBlockType& MatchedBlockType, const int32 BonusMatchSize)
+{
+	if (BonusMatchSize == 0 || MatchedBlockType.BonusMatchGoodsMultiplier == 0.f) {
+		return BaseMatchGoods;
 	}
 	else {
 		return UGoodsFunctionLibrary::MultiplyGoodsQuantities(
-			GetBaseMatchGoods(Dropper),
-			(BonusMatchSize * GetBlockType().BonusMatchGoodsMultiplier) + 1.f
+			BaseMatchGoods,
+			(BonusMatchSize * MatchedBlockType.BonusMatchGoodsMultiplier) + 1.f
 		);
 	}
 }
@@ -473,8 +506,11 @@ TArray<FGoodsQuantity> AMMBlock::GetMatchGoods_Implementation(const UGoodsDroppe
 void AMMBlock::OnMove_Implementation(const AMMPlayGridCell* ToCell)
 {
 	BlockState = EMMGridState::Moving;
-	StartMoveDistance = DistanceToCell();
+	BeginMovement();
 	bMoveSuccessful = true;
+	if (Grid()) {
+		Grid()->SyncBoardBlock(this);
+	}
 }
 
 
@@ -496,6 +532,11 @@ void AMMBlock::OnMatched_Implementation(UBlockMatch* Match)
 }
 
 
+void AMMBlock::OnBlockPooled_Implementation()
+{
+}
+
+
 void AMMBlock::OnBlockDestroyed_Implementation()
 {
 	if (GetBlockMesh()) {
@@ -537,11 +578,12 @@ void AMMBlock::OnUnsettle_Implementation()
 			}
 			*/
 		}
-		// Only delay settling if time is greater than threshold
+		// Only delay settling if time is greater than threshold. The grid calls OnSettle when the delay is over.
 		if (TmpSettleFallDelay > 0.03f)
 		{
-			UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("Setting timer to unsettle block %s at %s in %.3f seconds"), *GetName(), *GetCoords().ToString(), TmpSettleFallDelay);
-			GetWorldTimerManager().SetTimer(SettleFallDelayHandle, this, &AMMBlock::OnSettle, TmpSettleFallDelay, false);
+			UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("Delaying unsettle of block %s at %s by %.3f seconds"), *GetName(), *GetCoords().ToString(), TmpSettleFallDelay);
+			SettleStartTime = GetWorld()->GetTimeSeconds() + TmpSettleFallDelay;
+			bWaitingToSettle = true;
 		}
 		else {
 			UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("Unsettling block %s at %s with no delay"), *GetName(), *GetCoords().ToString());
@@ -555,6 +597,9 @@ void AMMBlock::OnUnsettle_Implementation()
 		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("Block %s at %s does not need to be unsettled"), *GetName(), *GetCoords().ToString());
 		SettleFinished();
 	}
+	if (Grid()) {
+		Grid()->SyncBoardBlock(this);
+	}
 }
 
 
@@ -564,7 +609,7 @@ void AMMBlock::OnSettle_Implementation()
 		UE_CLOG(bDebugLog, LogMMGame, Warning, TEXT("SettleBlock - Block %s at %s is already settling"), *GetName(), *GetCoords().ToString());
 		return;
 	}
-	GetWorldTimerManager().ClearTimer(SettleFallDelayHandle);
+	bWaitingToSettle = false;
 	BlockSettleFails = 0;
 	AMMPlayGridCell* SettleCell = nullptr;
 	
@@ -575,33 +620,24 @@ void AMMBlock::OnSettle_Implementation()
 		if (SettleToGridCell != nullptr) {
 			ChangeOwningGridCell(SettleToGridCell);
 		}
-		// Immediately queue the next falling block to unsettle
-		Grid()->UnsettleBlockAboveCell(Cell());
 	}
 	else 
 	{
-		// Check settle cell
+		// The grid has already given this block the cell it settles to. See AMMPlayGrid::PlanColumnSettle
 		bMoveSuccessful = false;
 		if (!IsMatched() && CanMove())
 		{
 			if (SettleToGridCell != nullptr)
 			{
 				UE_LOG(LogMMGame, Error, TEXT("   Block %s at %s that was not falling into grid had SettleToGridCell populated"), *GetName(), *GetCoords().ToString());
-				bMoveSuccessful = true;
 				ChangeOwningGridCell(SettleToGridCell);
 			}
-			SettleCell = FindSettleCell();
-			if (SettleCell != nullptr) 
-			{	
-				bMoveSuccessful = true;
-				FIntPoint OrigCoords = GetCoords();
-				if (!ChangeOwningGridCell(SettleCell)) {
-					UE_LOG(LogMMGame, Error, TEXT("   Block %s at %s that was not falling into grid changed cell to %s occupied by %s"), *GetName(), *OrigCoords.ToString(), *GetCoords().ToString(), *SettleCell->CurrentBlock->GetName());
-					if (OwningGridCell != nullptr) {
-						Grid()->UnsettleBlockAboveCell(OwningGridCell);
-					}
-				}
-			}						
+			// Blocks that were not planned, ex: blocks added directly into a cell, have their column planned now if they can fall.
+			SettleCell = Grid()->GetCell(GetCoords() + FIntPoint(0, -1));
+			if (SettleCell && !IsValid(SettleCell->CurrentBlock)) {
+				Grid()->PlanColumnSettle(GetCoords().X);
+			}
+			bMoveSuccessful = DistanceToCell() > 1.f;
 		}
 		if(!bMoveSuccessful)
 		{				
@@ -613,7 +649,7 @@ void AMMBlock::OnSettle_Implementation()
 		}
 	}
 	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("   Settling block %s to %s"), *GetName(), *GetCoords().ToString());
-	StartMoveDistance = DistanceToCell();
+	BeginMovement();
 	BlockState = EMMGridState::Settling;
 }
 
@@ -700,6 +736,15 @@ FVector AMMBlock::GetRelativeLocation()
 
 void AMMBlock::UpdateBlockVis_Implementation()
 {
+	if (RenderInstanceComponent) 
+	{
+		// Re-instance the block if its mesh was swapped, e.g. by a Blueprint on a type or damage change.
+		if (Grid() && GetBlockMesh() && RenderInstanceComponent->GetStaticMesh() != GetBlockMesh()->GetStaticMesh()) {
+			Grid()->AddBlockInstance(this);
+		}
+		UpdateRenderInstanceData();
+		return;
+	}
 	FLinearColor Color = GetBlockType().PrimaryColor;
 	if (bIsHighlighted)	{
 		Color = GetBlockType().AltColor;
@@ -713,15 +758,89 @@ void AMMBlock::UpdateBlockVis_Implementation()
 	if (BaseMatDynamic) {
 		BaseMatDynamic->SetVectorParameterValue("PrimaryColor", Color);
 		if (CanBeDamaged()) {
-			float DamagePercent = (GetBlockType().BaseHealth - (float)CurrentHealth) / FMath::Max(1.f, BlockType.BaseHealth);
+			float DamagePercent = (GetBlockType().BaseHealth - (float)CurrentHealth) / FMath::Max(1.f, GetBlockType().BaseHealth);
 			BaseMatDynamic->SetScalarParameterValue("DamagePercent", DamagePercent);
 		}
 	}
 }
 
 
+void AMMBlock::UpdateRenderInstanceData()
+{
+	if (RenderInstanceComponent == nullptr || RenderInstanceIndex == INDEX_NONE) {
+		return;
+	}
+	const FLinearColor Color = bIsHighlighted ? GetBlockType().AltColor : GetBlockType().PrimaryColor;
+	float DamagePercent = 0.f;
+	if (CanBeDamaged()) {
+		DamagePercent = (GetBlockType().BaseHealth - (float)CurrentHealth) / FMath::Max(1.f, GetBlockType().BaseHealth);
+	}
+	RenderInstanceComponent->SetCustomDataValue(RenderInstanceIndex, 0, Color.R, false);
+	RenderInstanceComponent->SetCustomDataValue(RenderInstanceIndex, 1, Color.G, false);
+	RenderInstanceComponent->SetCustomDataValue(RenderInstanceIndex, 2, Color.B, false);
+	RenderInstanceComponent->SetCustomDataValue(RenderInstanceIndex, 3, Color.A, false);
+	RenderInstanceComponent->SetCustomDataValue(RenderInstanceIndex, 4, DamagePercent, true);
+}
+
+
 void AMMBlock::BeginPlay()
 {
 	Super::BeginPlay();
 	UpdateBlockVis();
-}
\ No newline at end of file
+}
+
+
+/*
+* FMMBlockSlotSet
+*/
+bool FMMBlockSlotSet::Add(AMMBlock* Block)
+{
+	check(Block && Block->GetGridSlot() >= 0);
+	if (Contains(Block)) {
+		return false;
+	}
+	const int32 Slot = Block->GetGridSlot();
+	for (int32 i = Positions.Num(); i <= Slot; i++) {
+		Positions.Add(INDEX_NONE);
+	}
+	Positions[Slot] = Blocks.Add(Block);
+	return true;
+}
+
+
+bool FMMBlockSlotSet::Remove(const AMMBlock* Block)
+{
+	if (!Contains(Block)) {
+		return false;
+	}
+	const int32 Position = Positions[Block->GetGridSlot()];
+	Positions[Block->GetGridSlot()] = INDEX_NONE;
+	Blocks.RemoveAtSwap(Position, 1, false);
+	if (Blocks.IsValidIndex(Position) && Blocks[Position]) {
+		Positions[Blocks[Position]->GetGridSlot()] = Position;
+	}
+	return true;
+}
+
+
+bool FMMBlockSlotSet::Contains(const AMMBlock* Block) const
+{
+	if (Block == nullptr || !Positions.IsValidIndex(Block->GetGridSlot())) {
+		return false;
+	}
+	// Also compare the block, since blocks from other grids can have the same slot.
+	const int32 Position = Positions[Block->GetGridSlot()];
+	return Blocks.IsValidIndex(Position) && Blocks[Position] == Block;
+}
+
+
+void FMMBlockSlotSet::Empty()
+{
+	for (const AMMBlock* Block : Blocks) 
+	{
+		if (Block && Positions.IsValidIndex(Block->GetGridSlot())) {
+			Positions[Block->GetGridSlot()] = INDEX_NONE;
+		}
+	}
+	Blocks.Reset();
+}
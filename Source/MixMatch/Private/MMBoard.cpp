@@ -0,0 +1,648 @@
+#include "MMBoard.h"
+
+
+const int16 FMMBoard::EmptyType = INDEX_NONE;
+
+
+/** Count matching blocks starting next to StartIndex, stepping in the Sign direction (+1 or -1) along the orientation.
+ *  View is the board itself or an FMMBoardOverlay of it. */
+template<typename ViewType>
+static int32 CountRunInDirection(const ViewType& View, const FMMBoard& Board, const int32 StartIndex, const int32 Sign, const EMMOrientation Orientation)
+{
+	const FIntPoint Step = Orientation == EMMOrientation::Horizontal ? FIntPoint(Sign, 0) : FIntPoint(0, Sign);
+	const EMMBoardCellFlags MatchedFlag = Orientation == EMMOrientation::Horizontal ? EMMBoardCellFlags::MatchedHorizontal : EMMBoardCellFlags::MatchedVertical;
+	int16 PrevType = View.GetType(StartIndex);
+	// The last block in the run that is not bMatchNextToPreviousInMatchGroup. Wildcard blocks compare their neighbor against this one.
+	int16 AnchorType = Board.IsMatchNextToPrevious(PrevType) ? FMMBoard::EmptyType : PrevType;
+	int32 Count = 0;
+	FIntPoint Coords = Board.ToCoords(StartIndex) + Step;
+	while (Board.IsValidCoords(Coords))
+	{
+		const int32 Index = Board.ToIndex(Coords);
+		if (!View.IsMatchable(Index) || View.HasFlags(Index, MatchedFlag)) {
+			break;
+		}
+		const int16 CurType = View.GetType(Index);
+		const int16 CompareType = (Board.IsMatchNextToPrevious(PrevType) && AnchorType != FMMBoard::EmptyType) ? AnchorType : PrevType;
+		if (!Board.TypesMatch(CompareType, CurType)) {
+			break;
+		}
+		Count++;
+		if (!Board.IsMatchNextToPrevious(CurType)) {
+			AnchorType = CurType;
+		}
+		PrevType = CurType;
+		Coords += Step;
+	}
+	return Count;
+}
+
+
+FMMBoard::FMMBoard()
+{
+	SizeX = 0;
+	SizeY = 0;
+	Registry = nullptr;
+	bHasDirtyCells = false;
+	bMoveIndexInvalid = true;
+	ValidMoveCount = 0;
+	MoveIndexMatchSize = 0;
+	bUseBitBoards = false;
+}
+
+
+void FMMBoard::Init(const int32 InSizeX, const int32 InSizeY)
+{
+	SizeX = FMath::Max(InSizeX, 0);
+	SizeY = FMath::Max(InSizeY, 0);
+	Types.Init(EmptyType, SizeX * SizeY);
+	Flags.Init(EMMBoardCellFlags::None, SizeX * SizeY);
+	MoveBits.Init(false, SizeX * SizeY * 2);
+	DirtyCells.Init(false, SizeX * SizeY);
+	bHasDirtyCells = false;
+	bMoveIndexInvalid = true;
+	ValidMoveCount = 0;
+	RebuildBitBoards();
+}
+
+
+void FMMBoard::Reset()
+{
+	for (int32 i = 0; i < Types.Num(); i++)
+	{
+		Types[i] = EmptyType;
+		Flags[i] = EMMBoardCellFlags::None;
+	}
+	bMoveIndexInvalid = true;
+	RebuildBitBoards();
+}
+
+
+void FMMBoard::SetBlockTypeRegistry(const FBlockTypeRegistry* NewRegistry)
+{
+	Registry = NewRegistry;
+	bMoveIndexInvalid = true;
+	RebuildBitBoards();
+}
+
+
+void FMMBoard::SetCell(const int32 Index, const int16 TypeId, const EMMBoardCellFlags NewFlags)
+{
+	check(IsValidIndex(Index));
+	const EMMBoardCellFlags CellFlags = TypeId == EmptyType ? EMMBoardCellFlags::None : NewFlags;
+	if (Types[Index] != TypeId || Flags[Index] != CellFlags)
+	{
+		const int16 OldType = Types[Index];
+		Types[Index] = TypeId;
+		Flags[Index] = CellFlags;
+		MarkDirty(Index);
+		UpdateBitBoards(Index, OldType);
+	}
+}
+
+
+void FMMBoard::ClearCell(const int32 Index)
+{
+	SetCell(Index, EmptyType, EMMBoardCellFlags::None);
+}
+
+
+void FMMBoard::AddFlags(const int32 Index, const EMMBoardCellFlags NewFlags)
+{
+	check(IsValidIndex(Index));
+	if (!IsEmpty(Index) && !EnumHasAllFlags(Flags[Index], NewFlags)) 
+	{
+		Flags[Index] |= NewFlags;
+		MarkDirty(Index);
+		UpdateBitBoards(Index, Types[Index]);
+	}
+}
+
+
+void FMMBoard::RemoveFlags(const int32 Index, const EMMBoardCellFlags OldFlags)
+{
+	check(IsValidIndex(Index));
+	if (EnumHasAnyFlags(Flags[Index], OldFlags)) 
+	{
+		Flags[Index] &= ~OldFlags;
+		MarkDirty(Index);
+		UpdateBitBoards(Index, Types[Index]);
+	}
+}
+
+
+bool FMMBoard::IsMobile(const int32 Index) const
+{
+	return !IsEmpty(Index) && !HasFlags(Index, EMMBoardCellFlags::Immobile);
+}
+
+
+bool FMMBoard::IsMatchable(const int32 Index) const
+{
+	return !IsEmpty(Index) && !HasFlags(Index, EMMBoardCellFlags::Unsettled);
+}
+
+
+bool FMMBoard::IsSettled() const
+{
+	for (int32 i = 0; i < Flags.Num(); i++)
+	{
+		if (EnumHasAnyFlags(Flags[i], EMMBoardCellFlags::Unsettled)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+int32 FMMBoard::GetMatchRunLength(const int32 Index, const EMMOrientation Orientation) const
+{
+	if (!IsValidIndex(Index) || !IsMatchable(Index)) {
+		return 0;
+	}
+	return 1 + CountRunInDirection(*this, *this, Index, -1, Orientation) + CountRunInDirection(*this, *this, Index, 1, Orientation);
+}
+
+
+bool FMMBoard::CellHasMatch(const int32 Index, const int32 MinMatchSize) const
+{
+	return GetMatchRunLength(Index, EMMOrientation::Horizontal) >= MinMatchSize || GetMatchRunLength(Index, EMMOrientation::Vertical) >= MinMatchSize;
+}
+
+
+int32 FMMBoard::FindMatches(const int32 MinMatchSize, TArray<FMMBoardMatch>& OutMatches, const TBitArray<>* OnlyRunsContaining) const
+{
+	check(OnlyRunsContaining == nullptr || OnlyRunsContaining->Num() >= Num());
+	const int32 StartNum = OutMatches.Num();
+	if (UsesBitBoards())
+	{
+		// Use the bitboards to find which rows and columns contain a run of a single match class, then only scan those lines.
+		TBitArray<> RowsToScan(false, SizeY);
+		uint64 ColumnsToScan = 0;
+		for (const FMMBitBoard& ClassMask : ClassMasks)
+		{
+			const FMMBitBoard HorizontalStarts = (ClassMask & OpenHorizontal).RunStarts(MinMatchSize, EMMOrientation::Horizontal);
+			const FMMBitBoard VerticalStarts = (ClassMask & OpenVertical).RunStarts(MinMatchSize, EMMOrientation::Vertical);
+			for (int32 Y = 0; Y < SizeY; Y++)
+			{
+				if (HorizontalStarts.GetRow(Y) != 0) {
+					RowsToScan[Y] = true;
+				}
+				ColumnsToScan |= VerticalStarts.GetRow(Y);
+			}
+		}
+		for (TConstSetBitIterator<> It(RowsToScan); It; ++It) {
+			FindMatchesInLine(It.GetIndex() * SizeX, 1, SizeX, EMMOrientation::Horizontal, MinMatchSize, OutMatches, OnlyRunsContaining);
+		}
+		while (ColumnsToScan != 0)
+		{
+			const int32 X = (int32)FPlatformMath::CountTrailingZeros64(ColumnsToScan);
+			FindMatchesInLine(X, SizeX, SizeY, EMMOrientation::Vertical, MinMatchSize, OutMatches, OnlyRunsContaining);
+			ColumnsToScan &= ColumnsToScan - 1;
+		}
+		return OutMatches.Num() - StartNum;
+	}
+	for (int32 Y = 0; Y < SizeY; Y++) {
+		FindMatchesInLine(Y * SizeX, 1, SizeX, EMMOrientation::Horizontal, MinMatchSize, OutMatches, OnlyRunsContaining);
+	}
+	for (int32 X = 0; X < SizeX; X++) {
+		FindMatchesInLine(X, SizeX, SizeY, EMMOrientation::Vertical, MinMatchSize, OutMatches, OnlyRunsContaining);
+	}
+	return OutMatches.Num() - StartNum;
+}
+
+
+void FMMBoard::FindMatchesInLine(const int32 LineStart, const int32 Stride, const int32 LineLength, const EMMOrientation Orientation, const int32 MinMatchSize, TArray<FMMBoardMatch>& OutMatches, const TBitArray<>* OnlyRunsContaining) const
+{
+	const EMMBoardCellFlags MatchedFlag = Orientation == EMMOrientation::Horizontal ? EMMBoardCellFlags::MatchedHorizontal : EMMBoardCellFlags::MatchedVertical;
+	// Position along the line of the first block in the current run. INDEX_NONE when there is no run.
+	int32 RunStart = INDEX_NONE;
+	int16 PrevType = EmptyType;
+	// The last block in the run that is not bMatchNextToPreviousInMatchGroup. Wildcard blocks compare their neighbor against this one.
+	int16 AnchorType = EmptyType;
+	// Number of bMatchNextToPreviousInMatchGroup blocks at the end of the run.
+	int32 TrailingWildcards = 0;
+	// Go one past the end of the line so the last run is closed like any other.
+	for (int32 Pos = 0; Pos <= LineLength; Pos++)
+	{
+		const int32 Index = LineStart + (Pos * Stride);
+		const bool bCanMatch = Pos < LineLength && IsMatchable(Index) && !HasFlags(Index, MatchedFlag);
+		const int16 CurType = bCanMatch ? Types[Index] : EmptyType;
+		const bool bCurIsWildcard = IsMatchNextToPrevious(CurType);
+		if (RunStart != INDEX_NONE && bCanMatch)
+		{
+			const int16 CompareType = (IsMatchNextToPrevious(PrevType) && AnchorType != EmptyType) ? AnchorType : PrevType;
+			if (TypesMatch(CompareType, CurType))
+			{
+				// Run continues
+				PrevType = CurType;
+				if (bCurIsWildcard) {
+					TrailingWildcards++;
+				}
+				else {
+					AnchorType = CurType;
+					TrailingWildcards = 0;
+				}
+				continue;
+			}
+		}
+		// Current run, if any, ended at the previous position.
+		int32 NewRunStart = Pos;
+		if (RunStart != INDEX_NONE)
+		{
+			const int32 RunLength = Pos - RunStart;
+			bool bAddedMatch = false;
+			if (RunLength >= MinMatchSize)
+			{
+				bool bIncluded = OnlyRunsContaining == nullptr;
+				for (int32 i = RunStart; i < Pos && !bIncluded; i++) {
+					bIncluded = (*OnlyRunsContaining)[LineStart + (i * Stride)];
+				}
+				if (bIncluded)
+				{
+					FMMBoardMatch& NewMatch = OutMatches.AddDefaulted_GetRef();
+					NewMatch.StartCoords = ToCoords(LineStart + (RunStart * Stride));
+					NewMatch.Orientation = Orientation;
+					NewMatch.Length = RunLength;
+					bAddedMatch = true;
+				}
+			}
+			// Wildcards at the end of a run that was not matched can still begin a new run with the block that ended it.
+			if (!bAddedMatch && bCanMatch && TrailingWildcards > 0 && TypesMatch(PrevType, CurType)) {
+				NewRunStart = Pos - TrailingWildcards;
+			}
+		}
+		if (!bCanMatch)
+		{
+			RunStart = INDEX_NONE;
+			continue;
+		}
+		// Start a new run. Any blocks before Pos in it are wildcards, so only the current block can be an anchor.
+		RunStart = NewRunStart;
+		PrevType = CurType;
+		AnchorType = bCurIsWildcard ? EmptyType : CurType;
+		TrailingWildcards = bCurIsWildcard ? (Pos - RunStart) + 1 : 0;
+	}
+}
+
+
+void FMMBoard::GetTypesCompletingRun(const int32 Index, const int32 MinMatchSize, TBitArray<>& OutTypeIds) const
+{
+	const int32 NumTypes = Registry ? Registry->Num() : 0;
+	OutTypeIds.Init(false, NumTypes);
+	if (!IsValidIndex(Index)) {
+		return;
+	}
+	FMMBoardOverlay Overlay(*this);
+	for (int16 TypeId = 0; TypeId < NumTypes; TypeId++)
+	{
+		Overlay.SetCell(Index, TypeId, EMMBoardCellFlags::None);
+		if (Overlay.CellHasMatch(Index, MinMatchSize)) {
+			OutTypeIds[TypeId] = true;
+		}
+	}
+}
+
+
+void FMMBoard::GetTypesCompletingRun(const int32 Index, const int32 MinMatchSize, const TArray<int16>& CandidateTypeIds, TBitArray<>& OutTypeIds) const
+{
+	const int32 NumTypes = Registry ? Registry->Num() : 0;
+	OutTypeIds.Init(false, NumTypes);
+	if (!IsValidIndex(Index)) {
+		return;
+	}
+	FMMBoardOverlay Overlay(*this);
+	for (const int16 TypeId : CandidateTypeIds)
+	{
+		if (TypeId < 0 || TypeId >= NumTypes) {
+			continue;
+		}
+		Overlay.SetCell(Index, TypeId, EMMBoardCellFlags::None);
+		if (Overlay.CellHasMatch(Index, MinMatchSize)) {
+			OutTypeIds[TypeId] = true;
+		}
+	}
+}
+
+
+int32 FMMBoard::UpdateMoveIndex(const int32 MinMatchSize)
+{
+	if (MinMatchSize != MoveIndexMatchSize) 
+	{
+		MoveIndexMatchSize = MinMatchSize;
+		bMoveIndexInvalid = true;
+	}
+	if (bMoveIndexInvalid)
+	{
+		MoveBits.Init(false, Num() * 2);
+		ValidMoveCount = 0;
+		for (int32 i = 0; i < Num(); i++) {
+			UpdateMovesFromCell(i, MinMatchSize);
+		}
+	}
+	else if (bHasDirtyCells)
+	{
+		// A cell can change the outcome of any move whose cells are within MinMatchSize - 1 of it along a row or column.
+		// Moves are stored on their West/South cell, so re-evaluate every cell within MinMatchSize of a changed cell.
+		const int32 Radius = FMath::Max(MinMatchSize, 1);
+		TBitArray<> UpdatedCells(false, Num());
+		for (TConstSetBitIterator<> It(DirtyCells); It; ++It)
+		{
+			const FIntPoint Coords = ToCoords(It.GetIndex());
+			const int32 MinX = FMath::Max(Coords.X - Radius, 0);
+			const int32 MaxX = FMath::Min(Coords.X + Radius, SizeX - 1);
+			const int32 MinY = FMath::Max(Coords.Y - Radius, 0);
+			const int32 MaxY = FMath::Min(Coords.Y + Radius, SizeY - 1);
+			for (int32 Y = MinY; Y <= MaxY; Y++)
+			{
+				for (int32 X = MinX; X <= MaxX; X++)
+				{
+					const int32 Index = (Y * SizeX) + X;
+					if (!UpdatedCells[Index]) 
+					{
+						UpdatedCells[Index] = true;
+						UpdateMovesFromCell(Index, MinMatchSize);
+					}
+				}
+			}
+		}
+	}
+	DirtyCells.Init(false, Num());
+	bHasDirtyCells = false;
+	bMoveIndexInvalid = false;
+	return ValidMoveCount;
+}
+
+
+bool FMMBoard::IsValidMove(const int32 Index, const EMMDirection Direction) const
+{
+	if (bMoveIndexInvalid || !IsValidIndex(Index)) {
+		return false;
+	}
+	const FIntPoint Coords = ToCoords(Index);
+	switch (Direction)
+	{
+	case EMMDirection::East:
+		return MoveBits[Index * 2];
+	case EMMDirection::North:
+		return MoveBits[(Index * 2) + 1];
+	case EMMDirection::West:
+		return Coords.X > 0 && MoveBits[(Index - 1) * 2];
+	case EMMDirection::South:
+		return Coords.Y > 0 && MoveBits[((Index - SizeX) * 2) + 1];
+	default:
+		return false;
+	}
+}
+
+
+bool FMMBoard::SwapHasMatch(const int32 IndexA, const int32 IndexB, const int32 MinMatchSize) const
+{
+	if ((!IsEmpty(IndexA) && !IsMobile(IndexA)) || (!IsEmpty(IndexB) && !IsMobile(IndexB)) || (IsEmpty(IndexA) && IsEmpty(IndexB))) {
+		return false;
+	}
+	FMMBoardOverlay Overlay(*this);
+	Overlay.SwapCells(IndexA, IndexB);
+	return Overlay.CellHasMatch(IndexA, MinMatchSize) || Overlay.CellHasMatch(IndexB, MinMatchSize);
+}
+
+
+void FMMBoard::SwapCells(const int32 IndexA, const int32 IndexB)
+{
+	check(IsValidIndex(IndexA) && IsValidIndex(IndexB));
+	const int16 TypeA = Types[IndexA];
+	const EMMBoardCellFlags FlagsA = Flags[IndexA];
+	SetCell(IndexA, Types[IndexB], Flags[IndexB]);
+	SetCell(IndexB, TypeA, FlagsA);
+}
+
+
+int32 FMMBoard::ApplyGravity()
+{
+	int32 MovedCount = 0;
+	for (int32 X = 0; X < SizeX; X++)
+	{
+		// Lowest cell in the column that the next mobile block can fall to.
+		int32 LandingY = 0;
+		for (int32 Y = 0; Y < SizeY; Y++)
+		{
+			const int32 Index = (Y * SizeX) + X;
+			if (IsEmpty(Index)) {
+				continue;
+			}
+			if (!IsMobile(Index))
+			{
+				LandingY = Y + 1;
+				continue;
+			}
+			if (LandingY != Y)
+			{
+				SetCell((LandingY * SizeX) + X, Types[Index], Flags[Index]);
+				ClearCell(Index);
+				MovedCount++;
+			}
+			LandingY++;
+		}
+	}
+	return MovedCount;
+}
+
+
+int32 FMMBoard::Refill(TFunctionRef<int16(const int32 Index)> GetRefillType)
+{
+	int32 AddedCount = 0;
+	for (int32 X = 0; X < SizeX; X++)
+	{
+		int32 Y = SizeY;
+		while (Y > 0 && IsEmpty(((Y - 1) * SizeX) + X)) {
+			Y--;
+		}
+		for (; Y < SizeY; Y++)
+		{
+			const int32 Index = (Y * SizeX) + X;
+			const int16 TypeId = GetRefillType(Index);
+			if (TypeId == EmptyType) {
+				break;
+			}
+			SetCell(Index, TypeId, Registry && Registry->IsImmobile(TypeId) ? EMMBoardCellFlags::Immobile : EMMBoardCellFlags::None);
+			AddedCount++;
+		}
+	}
+	return AddedCount;
+}
+
+
+int32 FMMBoard::ResolveCascades(const int32 MinMatchSize, TFunctionRef<int16(const int32 Index)> GetRefillType, FMMBoardCascadeResult& OutResult, const int32 MaxSteps)
+{
+	const int32 StartSteps = OutResult.NumSteps();
+	TArray<FMMBoardMatch> StepMatches;
+	TBitArray<> MatchedCells;
+	for (int32 Step = 0; Step < MaxSteps; Step++)
+	{
+		StepMatches.Reset();
+		if (FindMatches(MinMatchSize, StepMatches) == 0) {
+			break;
+		}
+		MatchedCells.Init(false, Num());
+		for (const FMMBoardMatch& Match : StepMatches)
+		{
+			const EMMBoardCellFlags MatchedFlag = Match.Orientation == EMMOrientation::Horizontal ? EMMBoardCellFlags::MatchedHorizontal : EMMBoardCellFlags::MatchedVertical;
+			for (int32 Offset = 0; Offset < Match.Length; Offset++)
+			{
+				const int32 Index = ToIndex(Match.GetCoords(Offset));
+				OutResult.MatchedTypes.Add(Types[Index]);
+				MatchedCells[Index] = true;
+				AddFlags(Index, MatchedFlag);
+			}
+		}
+		OutResult.Matches.Append(StepMatches);
+		OutResult.StepMatchCounts.Add(StepMatches.Num());
+		for (TConstSetBitIterator<> It(MatchedCells); It; ++It)
+		{
+			if (!HasFlags(It.GetIndex(), EMMBoardCellFlags::Indestructible))
+			{
+				ClearCell(It.GetIndex());
+				OutResult.BlocksDestroyed++;
+			}
+		}
+		ApplyGravity();
+		OutResult.BlocksAdded += Refill(GetRefillType);
+	}
+	return OutResult.NumSteps() - StartSteps;
+}
+
+
+void FMMBoard::RebuildBitBoards()
+{
+	bUseBitBoards = Registry && Registry->HasMatchClasses() && FMMBitBoard::SupportsSize(SizeX, SizeY);
+	if (!bUseBitBoards)
+	{
+		ClassMasks.Empty();
+		OpenHorizontal = FMMBitBoard();
+		OpenVertical = FMMBitBoard();
+		return;
+	}
+	ClassMasks.Init(FMMBitBoard(SizeX, SizeY), Registry->GetNumMatchClasses());
+	OpenHorizontal.Init(SizeX, SizeY);
+	OpenVertical.Init(SizeX, SizeY);
+	for (int32 i = 0; i < Num(); i++) {
+		UpdateBitBoards(i, EmptyType);
+	}
+}
+
+
+void FMMBoard::UpdateBitBoards(const int32 Index, const int16 OldType)
+{
+	if (!UsesBitBoards()) {
+		return;
+	}
+	const FIntPoint Coords = ToCoords(Index);
+	const int16 OldClass = Registry->GetMatchClass(OldType);
+	if (ClassMasks.IsValidIndex(OldClass)) {
+		ClassMasks[OldClass].Set(Coords, false);
+	}
+	const int16 NewClass = Registry->GetMatchClass(Types[Index]);
+	if (ClassMasks.IsValidIndex(NewClass)) {
+		ClassMasks[NewClass].Set(Coords, true);
+	}
+	OpenHorizontal.Set(Coords, IsMatchable(Index) && !HasFlags(Index, EMMBoardCellFlags::MatchedHorizontal));
+	OpenVertical.Set(Coords, IsMatchable(Index) && !HasFlags(Index, EMMBoardCellFlags::MatchedVertical));
+}
+
+
+void FMMBoard::UpdateMovesFromCell(const int32 Index, const int32 MinMatchSize)
+{
+	const FIntPoint Coords = ToCoords(Index);
+	SetMoveBit(Index * 2, Coords.X < SizeX - 1 && SwapHasMatch(Index, Index + 1, MinMatchSize));
+	SetMoveBit((Index * 2) + 1, Coords.Y < SizeY - 1 && SwapHasMatch(Index, Index + SizeX, MinMatchSize));
+}
+
+
+void FMMBoard::SetMoveBit(const int32 BitIndex, const bool bValid)
+{
+	if ((bool)MoveBits[BitIndex] != bValid)
+	{
+		MoveBits[BitIndex] = bValid;
+		ValidMoveCount += bValid ? 1 : -1;
+	}
+}
+
+
+/*
+* FMMBoardOverlay
+*/
+FMMBoardOverlay::FMMBoardOverlay(const FMMBoard& InBoard)
+	: Board(InBoard)
+{
+}
+
+
+void FMMBoardOverlay::SetCell(const int32 Index, const int16 TypeId, const EMMBoardCellFlags NewFlags)
+{
+	check(Board.IsValidIndex(Index));
+	const EMMBoardCellFlags CellFlags = TypeId == FMMBoard::EmptyType ? EMMBoardCellFlags::None : NewFlags;
+	const int32 OverrideIndex = FindOverride(Index);
+	if (OverrideIndex == INDEX_NONE)
+	{
+		OverrideIndexes.Add(Index);
+		OverrideTypes.Add(TypeId);
+		OverrideFlags.Add(CellFlags);
+	}
+	else
+	{
+		OverrideTypes[OverrideIndex] = TypeId;
+		OverrideFlags[OverrideIndex] = CellFlags;
+	}
+}
+
+
+void FMMBoardOverlay::SwapCells(const int32 IndexA, const int32 IndexB)
+{
+	const int16 TypeA = GetType(IndexA);
+	const EMMBoardCellFlags FlagsA = GetFlags(IndexA);
+	SetCell(IndexA, GetType(IndexB), GetFlags(IndexB));
+	SetCell(IndexB, TypeA, FlagsA);
+}
+
+
+void FMMBoardOverlay::Reset()
+{
+	OverrideIndexes.Reset();
+	OverrideTypes.Reset();
+	OverrideFlags.Reset();
+}
+
+
+int16 FMMBoardOverlay::GetType(const int32 Index) const
+{
+	const int32 OverrideIndex = FindOverride(Index);
+	return OverrideIndex == INDEX_NONE ? Board.GetType(Index) : OverrideTypes[OverrideIndex];
+}
+
+
+EMMBoardCellFlags FMMBoardOverlay::GetFlags(const int32 Index) const
+{
+	const int32 OverrideIndex = FindOverride(Index);
+	return OverrideIndex == INDEX_NONE ? Board.GetFlags(Index) : OverrideFlags[OverrideIndex];
+}
+
+
+int32 FMMBoardOverlay::GetMatchRunLength(const int32 Index, const EMMOrientation Orientation) const
+{
+	if (!Board.IsValidIndex(Index) || !IsMatchable(Index)) {
+		return 0;
+	}
+	return 1 + CountRunInDirection(*this, Board, Index, -1, Orientation) + CountRunInDirection(*this, Board, Index, 1, Orientation);
+}
+
+
+bool FMMBoardOverlay::CellHasMatch(const int32 Index, const int32 MinMatchSize) const
+{
+	return GetMatchRunLength(Index, EMMOrientation::Horizontal) >= MinMatchSize || GetMatchRunLength(Index, EMMOrientation::Vertical) >= MinMatchSize;
+}
+
+
+int32 FMMBoardOverlay::FindOverride(const int32 Index) const
+{
+	return OverrideIndexes.Find(Index);
+}
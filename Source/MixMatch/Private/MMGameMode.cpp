@@ -101,23 +101,23 @@ UGoodsDropper* AMMGameMode::GetGoodsDropper()
 }
 
 
-bool AMMGameMode::GetBlockTypeByName(const FName& BlockTypeName, FBlockType& FoundBlockType)
+const FBlockType* AMMGameMode::GetBlockTypeByName(const FName& BlockTypeName)
 {
 	InitCachedBlockTypes();
-	FBlockType* pBlockType = CachedBlockTypes.Find(BlockTypeName);
-	if (pBlockType) {
-		FoundBlockType = *pBlockType;
-		return true;
-	}
-	else {
-		FoundBlockType = FBlockType();
-		UE_LOG(LogMMGame, Error, TEXT("MMGameMode::GetBlockTypeByName - Unknown block type: %s"), *BlockTypeName.ToString());
-		return false;
-	}
+	const FBlockType* FoundBlockType = BlockTypeRegistry.FindType(BlockTypeName);
+	UE_CLOG(FoundBlockType == nullptr, LogMMGame, Error, TEXT("MMGameMode::GetBlockTypeByName - Unknown block type: %s"), *BlockTypeName.ToString());
+	return FoundBlockType;
 }
 
 
-bool AMMGameMode::GetRandomBlockTypeNameForCell(FName& FoundBlockTypeName, const FAddBlockContext& BlockContext)
+const FBlockTypeRegistry& AMMGameMode::GetBlockTypeRegistry()
+{
+	InitCachedBlockTypes();
+	return BlockTypeRegistry;
+}
+
+
+bool AMMGameMode::GetRandomBlockTypeNameForCell(FName& FoundBlockTypeName, const FAddBlockContext& BlockContext, const bool bUseExcludedBlockNames)
 {
 	InitCachedBlockTypes();
 	AMMPlayGridCell* Cell = BlockContext.AddToCell;
@@ -126,88 +126,31 @@ bool AMMGameMode::GetRandomBlockTypeNameForCell(FName& FoundBlockTypeName, const
 		UE_LOG(LogMMGame, Error, TEXT("GameMode::GetRandomBlockTypeNameForCell - Cell at %s has null grid"), *(Cell->GetCoords()).ToString());
 		return false;
 	}
-	if (!InitWeightedBlockTypes(Cell->OwningGrid->GetBlockTypeSetName())) {
+	FBlockTypeSetSampler* Sampler = Cell->OwningGrid->GetBlockTypeSetSampler();
+	if (Sampler == nullptr) {
 		UE_LOG(LogMMGame, Error, TEXT("GameMode::GetRandomBlockTypeNameForCell - Could not find block type set with name %s"), *Cell->OwningGrid->GetBlockTypeSetName().ToString());
 		return false;
 	}
-	bool bUseExclusionList = BlockContext.ExcludedBlockNames.Num() > 0;
+	// For blocks dropping into grid, don't allow block types that are immobile
 	bool bPreventImmobile = BlockContext.OffsetAboveTopCell > 0.f || Cell->GetCoords().Y >= (Cell->OwningGrid->SizeY - 2);
-	float WeightSum = 0.f;
-	float PickedWeight = 0.f;
-	FName PickedBlockTypeName = NAME_None;
-	TArray<FWeightedBlockType> SelectedWeightedBlockTypes;
-	TArray<FWeightedBlockType> FallbackWeightedBlockTypes;
-	if (bUseExclusionList || bPreventImmobile)
-	{
-		float SpecialTotalBlockWeight = 0.f;
-		for (FWeightedBlockType WBT : CurrentWeightedBlockTypes) 
-		{
-			// For blocks dropping into grid
-			if (bPreventImmobile)
-			{
-				FBlockType TmpBlockType;
-				if (GetBlockTypeByName(WBT.BlockTypeName, TmpBlockType)) {
-					// Don't allow block types that are immobile
-					if (TmpBlockType.bImmobile) {
-						continue;
-					}
-				}
-			}
-			FallbackWeightedBlockTypes.Add(WBT);
-			if (!BlockContext.ExcludedBlockNames.Contains(WBT.BlockTypeName)) 
-			{
-				SpecialTotalBlockWeight += WBT.Weight;
-				SelectedWeightedBlockTypes.Add(WBT);
-			}
-		}
-		if (SelectedWeightedBlockTypes.Num() == 0) 
-		{
-			// If we ended up with no block types allowed, then pick a random one to add
-			int32 RandomIndex = FMath::RandRange(0, FallbackWeightedBlockTypes.Num() - 1);
-			SelectedWeightedBlockTypes.Add(FallbackWeightedBlockTypes[RandomIndex]);
-			SpecialTotalBlockWeight = FallbackWeightedBlockTypes[RandomIndex].Weight;
-		}
-		if (SelectedWeightedBlockTypes.Num() == 1) {
-			// If there is only one block type, just use that type
-			PickedBlockTypeName = SelectedWeightedBlockTypes[0].BlockTypeName;
-		}
-		else {
-			PickedWeight = FMath::RandRange(0.f, SpecialTotalBlockWeight);
-		}
-	}
-	else {
-		PickedWeight = FMath::RandRange(0.f, CurrentTotalBlockWeight);
-		SelectedWeightedBlockTypes = CurrentWeightedBlockTypes;
-	}
+	static const TArray<FName> NoExcludedBlockNames;
+	FName PickedBlockTypeName = Sampler->Pick(bUseExcludedBlockNames ? BlockContext.ExcludedBlockNames : NoExcludedBlockNames, BlockContext.ForbiddenBlockNames, bPreventImmobile, Cell->OwningGrid->GetRandomStream());
 	if (PickedBlockTypeName == NAME_None) 
 	{
-		// Haven't found a picked name yet, so find one in weighted list
-		for (FWeightedBlockType WBT : SelectedWeightedBlockTypes)
-		{
-			WeightSum += WBT.Weight;
-			if (WeightSum >= PickedWeight)
-			{
-				PickedBlockTypeName = WBT.BlockTypeName;
-				break;
-			}
-		}
-		if (PickedBlockTypeName == NAME_None) 
-		{
-			UE_LOG(LogMMGame, Error, TEXT("MMGameMode::GetRandomBlockTypeNameForCell - No weighted block type found in BlockTypeSet %s"), *CurrentWeightedBlockTypeSetName.ToString());
-			return false;
-		}
+		UE_LOG(LogMMGame, Error, TEXT("MMGameMode::GetRandomBlockTypeNameForCell - No weighted block type found in BlockTypeSet %s"), *Sampler->GetSetName().ToString());
+		return false;
 	}
-	// Grab the actual block type from our block type name map to make sure the picked name is in our map. (should always be found)
-	FBlockType* pBlockType = CachedBlockTypes.Find(PickedBlockTypeName);
+	// Grab the actual block type from the registry to make sure the picked name is in it. (should always be found)
+	const FBlockType* pBlockType = BlockTypeRegistry.FindType(PickedBlockTypeName);
 	if (pBlockType) 
 	{
 		FoundBlockTypeName = pBlockType->Name;
-		//UE_LOG(LogMMGame, Log, TEXT("MMGameMode::GetRandomBlockTypeNameForCell - Got block type %s from BlockTypeSet %s"), *FoundBlockTypeName.ToString(), *CurrentWeightedBlockTypeSetName.ToString());
+		//UE_LOG(LogMMGame, Log, TEXT("MMGameMode::GetRandomBlockTypeNameForCell - Got block type %s from BlockTypeSet %s"), *FoundBlockTypeName.ToString(), *Sampler->GetSetName().ToString());
 		return true;
 	}
 	else 
 	{
-		UE_LOG(LogMMGame, Error, TEXT("MMGameMode::GetRandomBlockTypeNameForCell - Block type %s not found in BlockTypeSet %s"), *PickedBlockTypeName.ToString(), *CurrentWeightedBlockTypeSetName.ToString());
+		UE_LOG(LogMMGame, Error, TEXT("MMGameMode::GetRandomBlockTypeNameForCell - Block type %s not found in BlockTypeSet %s"), *PickedBlockTypeName.ToString(), *Sampler->GetSetName().ToString());
 		return false;
 	}
 }
@@ -220,6 +163,21 @@ bool AMMGameMode::GetBlockClass(TSubclassOf<AMMBlock>& BlockClass)
 }
 
 
+TSubclassOf<AMMBlock> AMMGameMode::GetLoadedBlockClass(const FBlockType& BlockType)
+{
+	const TSubclassOf<AMMBlock>* FoundClass = LoadedBlockClasses.Find(BlockType.Name);
+	if (FoundClass && *FoundClass != nullptr) {
+		return *FoundClass;
+	}
+	UE_CLOG(bDebugLog, LogMMGame, Warning, TEXT("MMGameMode::GetLoadedBlockClass - Class for block type %s was not preloaded. Loading now."), *BlockType.Name.ToString());
+	TSubclassOf<AMMBlock> BlockClass = BlockType.BlockClass.LoadSynchronous();
+	if (BlockClass != nullptr) {
+		LoadedBlockClasses.Add(BlockType.Name, BlockClass);
+	}
+	return BlockClass;
+}
+
+
 float AMMGameMode::GetBlockMoveSpeed()
 {
 	AMMPlayerController* PC = Cast<AMMPlayerController>(UGameplayStatics::GetPlayerController(GetWorld(), 0));
@@ -269,8 +227,7 @@ bool AMMGameMode::GetGoodsForMatch_Implementation(const UBlockMatch* Match, FGoo
 	if (!Match->Blocks.IsValidIndex(0) || Match->Blocks[0]->Grid() == nullptr) {
 		return false;
 	}
-	int32 BonusMatchSize = MatchSize - Match->Blocks[0]->Grid()->GetMinimumMatchSize();
-	float OverallMult = 0.f;
+	TArray<const FBlockType*> MatchedTypes;
 	TArray<FGoodsQuantity> TempTotalGoods;
 	
 	// Iterate over each block, getting dropped goods from each
@@ -278,26 +235,29 @@ bool AMMGameMode::GetGoodsForMatch_Implementation(const UBlockMatch* Match, FGoo
 	{
 		check(Block);
 		TempTotalGoods.Append(Block->GetMatchGoods(GoodsDropper, Match));
-		if (Block->GetBlockType().OverallMatchGoodsMultiplier > 0.f && Block->GetBlockType().OverallMatchGoodsMultiplier != 1.f) {
-			OverallMult += Block->GetBlockType().OverallMatchGoodsMultiplier;
+		MatchedTypes.Add(&Block->GetBlockType());
+	}
+	MatchGoods.Goods.Append(GetGoodsForMatchedTypes(MatchedTypes, TempTotalGoods));
+	return true;
+}
+
+
+TArray<FGoodsQuantity> AMMGameMode::GetGoodsForMatchedTypes(const TArray<const FBlockType*>& MatchedTypes, const TArray<FGoodsQuantity>& BlockGoods)
+{
+	float OverallMult = 0.f;
+	for (const FBlockType* BlockType : MatchedTypes)
+	{
+		if (BlockType && BlockType->OverallMatchGoodsMultiplier > 0.f && BlockType->OverallMatchGoodsMultiplier != 1.f) {
+			OverallMult += BlockType->OverallMatchGoodsMultiplier;
 		}
 	}
+	// Use the AddGoodsQuantities function to consolidate all goods quantities to one total per goods type.
+	TArray<FGoodsQuantity> TotalGoods = UGoodsFunctionLibrary::AddGoodsQuantities(TArray<FGoodsQuantity>(), BlockGoods);
 	// After normal goods, including bonus goods, have been determined, apply the cumulative overall multiplier. (if any)
-	if (OverallMult > 0.f) 
-	{
-		MatchGoods.Goods.Append(
-			UGoodsFunctionLibrary::MultiplyGoodsQuantities(
-				// Use the AddGoodsQuantities function to consolidate all goods quantities to one total per goods type.}
-				UGoodsFunctionLibrary::AddGoodsQuantities(TArray<FGoodsQuantity>(), TempTotalGoods), 
-				OverallMult
-			)
-		);
-	}
-	else {
-		// Use the AddGoodsQuantities function to consolidate all goods quantities to one total per goods type.}
-		MatchGoods.Goods.Append(UGoodsFunctionLibrary::AddGoodsQuantities(TArray<FGoodsQuantity>(), TempTotalGoods));
+	if (OverallMult > 0.f) {
+		return UGoodsFunctionLibrary::MultiplyGoodsQuantities(TotalGoods, OverallMult);
 	}
-	return true;
+	return TotalGoods;
 }
 
 
@@ -311,97 +271,120 @@ int32 AMMGameMode::GetScoreForMatch(const UBlockMatch* Match)
 	if (!Match->Blocks.IsValidIndex(0) || Match->Blocks[0]->Grid() == nullptr) {
 		return 0;
 	}
-	int32 BonusMatchSize = MatchSize - Match->Blocks[0]->Grid()->GetMinimumMatchSize();
+	TArray<const FBlockType*> MatchedTypes;
+	for (AMMBlock* Block : Match->Blocks) {
+		MatchedTypes.Add(&Block->GetBlockType());
+	}
+	return GetScoreForMatchedTypes(MatchedTypes, MatchSize - Match->Blocks[0]->Grid()->GetMinimumMatchSize());
+}
+
+
+int32 AMMGameMode::GetScoreForMatchedTypes(const TArray<const FBlockType*>& MatchedTypes, const int32 BonusMatchSize)
+{
 	float OverallMult = 0.f;
 	int32 TotalScore = 0;
-	for (AMMBlock* Block : Match->Blocks)
+	for (const FBlockType* BlockType : MatchedTypes)
 	{
+		if (BlockType == nullptr) {
+			continue;
+		}
 		if (BonusMatchSize > 0) {
-			TotalScore += Block->GetBlockType().PointsPerBlock + (Block->GetBlockType().PointsPerBlock * (BonusMatchSize * Block->GetBlockType().BonusMatchPointsMultiplier));
+			TotalScore += BlockType->PointsPerBlock + (BlockType->PointsPerBlock * (BonusMatchSize * BlockType->BonusMatchPointsMultiplier));
 		}
 		else {
-			TotalScore += Block->GetBlockType().PointsPerBlock;
+			TotalScore += BlockType->PointsPerBlock;
 		}
-		if (0.f != Block->GetBlockType().OverallMatchPointsMultiplier != 1.f) {
-			OverallMult += Block->GetBlockType().OverallMatchPointsMultiplier;
+		if (BlockType->OverallMatchPointsMultiplier > 0.f && BlockType->OverallMatchPointsMultiplier != 1.f) {
+			OverallMult += BlockType->OverallMatchPointsMultiplier;
 		}
 	}
+	// Now apply any OverallMatchPointsMultiplier(s)
 	if (OverallMult > 0.f) {
 		TotalScore = TotalScore * OverallMult;
 	}
-	// Now apply any OverallMatchPointsMultiplier(s)
 	return TotalScore;
 }
 
 
-bool AMMGameMode::SetBlockTypeSetName(const FName& BlockTypeSetName)
-{
-	return InitWeightedBlockTypes(BlockTypeSetName);
-}
-
-
 void AMMGameMode::InitCachedBlockTypes(bool bForceRefresh)
 {
-	if (!(CachedBlockTypes.Num() == 0 || bForceRefresh)) { return; }
+	if (!(BlockTypeRegistry.Num() == 0 || bForceRefresh)) { return; }
 	if (!IsValid(BlocksTable)) 
 	{
 		UE_LOG(LogMMGame, Error, TEXT("AMMGameMode::InitCachedBlockTypes - BlocksTable is not valid"));
 		return;
 	}
 	TArray<FSoftObjectPath> AssetsToCache;
-	CachedBlockTypes.Empty(BlocksTable->GetRowMap().Num());
+	TMap<FName, FBlockType> BlockTypes;
+	BlockTypes.Reserve(BlocksTable->GetRowMap().Num());
+	LoadedBlockClasses.Empty(BlocksTable->GetRowMap().Num());
 	for (const TPair<FName, uint8*>& It : BlocksTable->GetRowMap())
 	{
-		FBlockType FoundBlockType = *reinterpret_cast<FBlockType*>(It.Value);
-		CachedBlockTypes.Add(It.Key, FoundBlockType);
+		const FBlockType& FoundBlockType = BlockTypes.Add(It.Key, *reinterpret_cast<FBlockType*>(It.Value));
 		AssetsToCache.AddUnique(FoundBlockType.BlockClass.ToSoftObjectPath());
 	}
+	BlockTypeRegistry.Build(BlockTypes);
+	// Samplers hold block type flags from the registry.
+	RebuildBlockTypeSetSamplers();
 	CacheAssets(AssetsToCache, FName(TEXT("Blocks")));
 }
 
 
 void AMMGameMode::InitWeightedBlockTypeSets(bool bForceRefresh)
 {
-	if (!(CurrentWeightedBlockTypeSets.Num() == 0 || bForceRefresh)) { return; }
+	if (!(WeightedBlockTypeSets.Num() == 0 || bForceRefresh)) { return; }
 	if (!IsValid(BlockWeightsTable)) {
 		UE_LOG(LogMMGame, Error, TEXT("MMGameMode::InitWeightedBlockTypeSets - BlockWeightsTable is null."));
 	}
-	CurrentWeightedBlockTypeSets.Empty(BlockWeightsTable->GetRowMap().Num());
-	CurrentTotalBlockWeight = 0.f;
+	WeightedBlockTypeSets.Empty(BlockWeightsTable->GetRowMap().Num());
 	for (const TPair<FName, uint8*>& It : BlockWeightsTable->GetRowMap())
 	{
 		FWeightedBlockTypeSet WBlockTypeSet = *reinterpret_cast<FWeightedBlockTypeSet*>(It.Value);
 		if (WBlockTypeSet.WeightedBlockTypes.Num() > 0) {
-			CurrentWeightedBlockTypeSets.Add(WBlockTypeSet.Name, WBlockTypeSet);
+			WeightedBlockTypeSets.Add(WBlockTypeSet.Name, WBlockTypeSet);
 		}
 	}
+	RebuildBlockTypeSetSamplers();
 }
 
 
-bool AMMGameMode::InitWeightedBlockTypes(const FName& BlockTypeSetName, bool bForceRefresh)
+TSharedPtr<FBlockTypeSetSampler> AMMGameMode::GetBlockTypeSetSampler(const FName& BlockTypeSetName)
 {
-	if (BlockTypeSetName == CurrentWeightedBlockTypeSetName && !(CurrentWeightedBlockTypes.Num() == 0 || bForceRefresh)) {
-		return true;
-	}
+	InitCachedBlockTypes();
 	InitWeightedBlockTypeSets();
-	CurrentTotalBlockWeight = 0.f;
-	CurrentWeightedBlockTypes.Empty();
-	if (CurrentWeightedBlockTypeSets.Contains(BlockTypeSetName))
-	{		
-		UE_LOG(LogMMGame, Log, TEXT("MMGameMode::InitWeightedBlockTypes - Using BlockTypeSet %s"), *BlockTypeSetName.ToString());
-		CurrentWeightedBlockTypeSetName = BlockTypeSetName;
-		CurrentWeightedBlockTypes.Append(CurrentWeightedBlockTypeSets[BlockTypeSetName].WeightedBlockTypes);
-		for (FWeightedBlockType WBT : CurrentWeightedBlockTypes)
+	const TSharedPtr<FBlockTypeSetSampler>* FoundSampler = BlockTypeSetSamplers.Find(BlockTypeSetName);
+	if (FoundSampler) {
+		return *FoundSampler;
+	}
+	const FWeightedBlockTypeSet* BlockTypeSet = WeightedBlockTypeSets.Find(BlockTypeSetName);
+	if (BlockTypeSet == nullptr) 
+	{
+		UE_LOG(LogMMGame, Error, TEXT("MMGameMode::GetBlockTypeSetSampler - Block type set with name %s not found in weighted block type sets table."), *BlockTypeSetName.ToString());
+		return nullptr;
+	}
+	UE_LOG(LogMMGame, Log, TEXT("MMGameMode::GetBlockTypeSetSampler - Building sampler for BlockTypeSet %s"), *BlockTypeSetName.ToString());
+	TSharedPtr<FBlockTypeSetSampler> Sampler = MakeShared<FBlockTypeSetSampler>();
+	Sampler->Build(*BlockTypeSet, BlockTypeRegistry);
+	BlockTypeSetSamplers.Add(BlockTypeSetName, Sampler);
+	return Sampler;
+}
+
+
+void AMMGameMode::RebuildBlockTypeSetSamplers()
+{
+	for (TPair<FName, TSharedPtr<FBlockTypeSetSampler>>& It : BlockTypeSetSamplers)
+	{
+		const FWeightedBlockTypeSet* BlockTypeSet = WeightedBlockTypeSets.Find(It.Key);
+		if (BlockTypeSet) {
+			It.Value->Build(*BlockTypeSet, BlockTypeRegistry);
+		}
+		else
 		{
-			if (WBT.Weight > 0.f)			{
-				CurrentTotalBlockWeight += WBT.Weight;
-			}
+			UE_LOG(LogMMGame, Warning, TEXT("MMGameMode::RebuildBlockTypeSetSamplers - Block type set %s is no longer in the weighted block type sets table."), *It.Key.ToString());
+			FWeightedBlockTypeSet EmptySet;
+			EmptySet.Name = It.Key;
+			It.Value->Build(EmptySet, BlockTypeRegistry);
 		}
-		return true;
-	}
-	else {
-		UE_LOG(LogMMGame, Error, TEXT("MMGameMode::InitWeightedBlockTypes - Block type set with name %s not found in weighted block type sets table."), *BlockTypeSetName.ToString());
-		return false;
 	}
 }
 
@@ -546,6 +529,9 @@ void AMMGameMode::OnAssetsCached(const TArray<FSoftObjectPath> CachedAssets, con
 	//for (FSoftObjectPath CurRef : CachedAssets)	{
 	//	AssetsToCache.RemoveSingle(CurRef);
 	//}
+	if (GroupName == FName(TEXT("Blocks"))) {
+		CacheLoadedBlockClasses();
+	}
 	AssetGroupsPendingLoad.RemoveSingle(GroupName);
 	if (AssetGroupsPendingLoad.Num() == 0) {
 		OnLoadComplete();
@@ -553,6 +539,19 @@ void AMMGameMode::OnAssetsCached(const TArray<FSoftObjectPath> CachedAssets, con
 }
 
 
+void AMMGameMode::CacheLoadedBlockClasses()
+{
+	for (int16 TypeId = 0; TypeId < BlockTypeRegistry.Num(); TypeId++)
+	{
+		UClass* BlockClass = BlockTypeRegistry.GetType(TypeId)->BlockClass.Get();
+		if (BlockClass != nullptr) {
+			LoadedBlockClasses.Add(BlockTypeRegistry.GetTypeName(TypeId), BlockClass);
+		}
+	}
+	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMGameMode::CacheLoadedBlockClasses - %d of %d block classes loaded"), LoadedBlockClasses.Num(), BlockTypeRegistry.Num());
+}
+
+
 void AMMGameMode::OnLoadComplete_Implementation()
 {
 
@@ -5,9 +5,12 @@
 #include "UObject/ConstructorHelpers.h"
 #include "Engine/StaticMesh.h"
 #include "Components/StaticMeshComponent.h"
+#include "Components/InstancedStaticMeshComponent.h"
 #include "Components/TextRenderComponent.h"
 #include "Components/BillboardComponent.h"
 #include "Kismet/GameplayStatics.h"
+#include "Algo/BinarySearch.h"
+#include "Curves/CurveFloat.h"
 #include "..\MixMatch.h"
 #include "MMMath.h"
 #include "MMPlayGridCell.h"
@@ -18,6 +21,7 @@
 #include "GameEffect/GameEffectPreviewActor.h"
 #include "Goods/GoodsQuantity.h"
 #include "Goods/GoodsFunctionLibrary.h"
+#include "Goods/GoodsDropper.h"
 #include "Goods/UsableGoodsContext.h"
 
 
@@ -54,6 +58,13 @@ AMMPlayGrid::AMMPlayGrid()
 	BlockToggleControlMesh->OnClicked.AddDynamic(this, &AMMPlayGrid::ToggleBlocksClicked);
 	BlockToggleControlMesh->OnInputTouchBegin.AddDynamic(this, &AMMPlayGrid::OnFingerPressedToggleBlocks);
 
+	// Cell backgrounds, when bInstanceCellMeshes
+	CellBackgroundInstances = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("CellBackgroundInstances"));
+	CellBackgroundInstances->SetupAttachment(SceneRoot);
+	CellBackgroundInstances->NumCustomDataFloats = 1;
+	CellBackgroundInstances->OnClicked.AddDynamic(this, &AMMPlayGrid::CellBackgroundClicked);
+	CellBackgroundInstances->OnInputTouchBegin.AddDynamic(this, &AMMPlayGrid::OnFingerPressedCellBackground);
+
 #if WITH_EDITORONLY_DATA
 	// Billboard
 	Billboard = CreateDefaultSubobject<UBillboardComponent>(TEXT("Billboard"));
@@ -66,6 +77,10 @@ AMMPlayGrid::AMMPlayGrid()
 		AddOwnedComponent(GoodsInventory);
 	}
 
+	// The grid only ticks while it has work to do. See WakeGrid()
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = true;
+
 	// Set defaults
 	CellClass = AMMPlayGridCell::StaticClass();
 	GridState = EMMGridState::Normal;
@@ -87,6 +102,36 @@ void AMMPlayGrid::Tick(float DeltaSeconds)
 	Super::Tick(DeltaSeconds);
 	PlaySounds(PlaySoundQueue);
 	PlaySoundQueue.Empty();
+	AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
+	if (GameMode) {
+		BlockMoveSpeed = GameMode->GetBlockMoveSpeed();
+	}
+	int32 ActiveBlockCount = StepGrid(DeltaSeconds);
+	if (IsFastForwarding())
+	{
+		// All block movement finishes immediately, so keep stepping to resolve the whole cascade this frame.
+		// Blueprint match animations may still take time, so the number of steps is limited.
+		for (int32 Step = 1; Step < MaxFastForwardSteps && !(ActiveBlockCount == 0 && IsGridIdle()); Step++) {
+			ActiveBlockCount = StepGrid(DeltaSeconds);
+		}
+		if (ActiveBlockCount == 0 && IsGridIdle()) {
+			bFastForwardOnce = false;
+		}
+	}
+	// Each replayed move waits for the previous one to finish, as the player's did.
+	if (IsReplaying() && ActiveBlockCount == 0 && IsGridIdle() && StepReplay()) {
+		return;
+	}
+	// Stop ticking until something gives the grid more work.
+	if (ActiveBlockCount == 0 && IsGridIdle()) {
+		SetActorTickEnabled(false);
+	}
+}
+
+
+int32 AMMPlayGrid::StepGrid(float DeltaSeconds)
+{
+	const int32 ActiveBlockCount = BlockMotionTick(DeltaSeconds);
 
 	switch (GridState) {
 	case EMMGridState::Moving:
@@ -103,6 +148,7 @@ void AMMPlayGrid::Tick(float DeltaSeconds)
 				UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("All Blocks Finished Moving"));
 				GridLockedState = EMMGridLockState::Unchecked;
 				GridState = EMMGridState::Normal;
+				UpdateGridLockedState();
 			}
 		}		
 		break;
@@ -124,6 +170,7 @@ void AMMPlayGrid::Tick(float DeltaSeconds)
 				UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("All Blocks Finished Matching"));
 				GridLockedState = EMMGridLockState::Unchecked;
 				GridState = EMMGridState::Normal;
+				UpdateGridLockedState();
 			}
 		}
 		else if (bAllMatchesFinished) {
@@ -143,24 +190,108 @@ void AMMPlayGrid::Tick(float DeltaSeconds)
 		else 
 		{
 			// Check if the grid is locked
-			if (GridLockedState == EMMGridLockState::Unchecked || GridLockedState == EMMGridLockState::Checking)
-			{
-				if (CheckGridIsLocked() == EMMGridLockState::Locked)
-				{
-					// Call delegate if grid is locked
-					OnGridLocked.Broadcast(this);
-				}
-			}
+			UpdateGridLockedState();
 		}
 		break;
 	default:
 		break;
 	}
+	return ActiveBlockCount;
+}
+
+
+void AMMPlayGrid::FastForward()
+{
+	bFastForwardOnce = true;
+	WakeGrid();
+}
+
+
+float AMMPlayGrid::GetMoveAlpha(const UCurveFloat* Curve, const float Distance, const float ElapsedTime)
+{
+	if (IsFastForwarding() || Distance <= 1.f || BlockMoveSpeed <= 0.f) {
+		return 1.f;
+	}
+	// Fraction of the distance that would be covered at the unscaled move speed.
+	const float LinearAlpha = (ElapsedTime * BlockMoveSpeed) / Distance;
+	if (Curve == nullptr) {
+		return FMath::Clamp(LinearAlpha, 0.f, 1.f);
+	}
+	if (LinearAlpha <= 0.f) {
+		return 0.f;
+	}
+	// The curve scales speed by percent of the move complete. Look up the percent complete in the table of times to reach each percent.
+	const TArray<float>& Times = GetMoveCurveTimes(Curve);
+	const int32 NumSteps = Times.Num() - 1;
+	if (LinearAlpha >= Times[NumSteps]) {
+		return 1.f;
+	}
+	const int32 Step = FMath::Max(0, Algo::UpperBound(Times, LinearAlpha) - 1);
+	const float StepTime = Times[Step + 1] - Times[Step];
+	const float StepAlpha = StepTime > 0.f ? (LinearAlpha - Times[Step]) / StepTime : 0.f;
+	return (Step + StepAlpha) / NumSteps;
+}
+
+
+const TArray<float>& AMMPlayGrid::GetMoveCurveTimes(const UCurveFloat* Curve)
+{
+	check(Curve);
+	const TArray<float>* FoundTimes = MoveCurveTimes.Find(Curve);
+	if (FoundTimes) {
+		return *FoundTimes;
+	}
+	// Time for a move of distance 1 at speed 1 to reach each percent complete, with the speed scaled by the curve.
+	// Speed scale is clamped so a block never stops.
+	const int32 NumSteps = 32;
+	const float MinSpeedScale = 0.05f;
+	TArray<float>& Times = MoveCurveTimes.Add(Curve);
+	Times.SetNumUninitialized(NumSteps + 1);
+	Times[0] = 0.f;
+	float PrevInvSpeed = 1.f / FMath::Max(Curve->GetFloatValue(0.f), MinSpeedScale);
+	for (int32 i = 1; i <= NumSteps; i++)
+	{
+		const float InvSpeed = 1.f / FMath::Max(Curve->GetFloatValue((float)i / NumSteps), MinSpeedScale);
+		Times[i] = Times[i - 1] + ((PrevInvSpeed + InvSpeed) * 0.5f / NumSteps);
+		PrevInvSpeed = InvSpeed;
+	}
+	return Times;
+}
+
+
+void AMMPlayGrid::WakeGrid()
+{
+	if (!IsActorTickEnabled()) {
+		SetActorTickEnabled(true);
+	}
+}
+
+
+bool AMMPlayGrid::IsGridIdle() const
+{
+	return GridState == EMMGridState::Normal
+		&& (GridLockedState == EMMGridLockState::NotLocked || GridLockedState == EMMGridLockState::Locked)
+		&& BlocksToDestroy.Num() == 0
+		&& PlaySoundQueue.Num() == 0
+		&& BlockMatches.Num() == 0
+		&& UnsettledBlocks.Num() == 0
+		&& ToBeUnsettledBlocks.Num() == 0;
 }
 
 
 void AMMPlayGrid::SettleTick(float DeltaSeconds)
 {
+	// Start settling the unsettled blocks whose settle delay has passed. Collected first since OnSettle can change UnsettledBlocks.
+	const float Now = GetWorld()->GetTimeSeconds();
+	TArray<AMMBlock*, TInlineAllocator<16>> ReadyBlocks;
+	for (AMMBlock* Block : UnsettledBlocks)
+	{
+		if (IsValid(Block) && Block->IsWaitingToSettle() && (IsFastForwarding() || Now >= Block->GetSettleStartTime())) {
+			ReadyBlocks.Add(Block);
+		}
+	}
+	for (AMMBlock* Block : ReadyBlocks) {
+		Block->OnSettle();
+	}
 	// Iterate blocks in order to settle them. Iterating blocks in order so settling begins from bottom->up.
 	for (int32 i = 0; i < Cells.Num(); i++)
 	{
@@ -191,11 +322,13 @@ void AMMPlayGrid::SettleTick(float DeltaSeconds)
 		}
 	}
 
+	// Plan where blocks fall to in columns that had cells open.
+	PlanColumnSettles();
 	// Unsettle all waiting to be unsettled
 	if (ToBeUnsettledBlocks.Num() > 0)
 	{
 		int32 Index = 0;		
-		// Iterate using index because blocks may be added at end of ToBeUnsettledBlocks list as blocks unsettle blocks above them.
+		// Iterate using index in case blocks are added at end of ToBeUnsettledBlocks list while unsettling.
 		while (Index < ToBeUnsettledBlocks.Num())
 		{
 			if (ToBeUnsettledBlocks.IsValidIndex(Index))
@@ -221,16 +354,41 @@ void AMMPlayGrid::SettleTick(float DeltaSeconds)
 		else {
 			GridLockedState = EMMGridLockState::Unchecked;
 			GridState = EMMGridState::Normal;
+			UpdateGridLockedState();
 			UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("All Blocks Finished Settling"));
 		}
 	}
 }
 
 
+int32 AMMPlayGrid::BlockMotionTick(float DeltaSeconds)
+{
+	int32 ActiveBlockCount = 0;
+	// Settling blocks are ticked in SettleTick, in bottom to top order.
+	for (int32 i = 0; i < Blocks.Num(); i++)
+	{
+		AMMBlock* Block = Blocks[i];
+		if (Block->BlockState == EMMGridState::Moving) 
+		{
+			Block->MoveTick(DeltaSeconds);
+			ActiveBlockCount++;
+		}
+		else if (Block->BlockState == EMMGridState::Matching) 
+		{
+			Block->MatchTick(DeltaSeconds);
+			ActiveBlockCount++;
+		}
+	}
+	return ActiveBlockCount;
+}
+
+
 void AMMPlayGrid::StartPlayGrid_Implementation()
 {
+	SeedRandomStream();
 	PlayerMovesCount = 0;
 	FillGridBlocks();
+	WakeGrid();
 }
 
 
@@ -258,6 +416,73 @@ void AMMPlayGrid::BeginPlay()
 }
 
 
+void AMMPlayGrid::SeedRandomStream()
+{
+	Recording = FMMGridRecording();
+	if (IsReplaying()) {
+		Recording.Seed = ReplayRecording.Seed;
+	}
+	else if (RandomSeed != 0) {
+		Recording.Seed = RandomSeed;
+	}
+	else {
+		// Never 0, which RandomSeed uses to mean pick a new seed.
+		Recording.Seed = FMath::RandRange(1, INT_MAX);
+	}
+	Recording.SizeX = SizeX;
+	Recording.SizeY = SizeY;
+	Recording.BlockTypeSetName = BlockTypeSetName;
+	RandStream.Initialize(Recording.Seed);
+	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::SeedRandomStream - Grid %s seeded with %d"), *GetName(), Recording.Seed);
+}
+
+
+bool AMMPlayGrid::StartReplay(const FMMGridRecording& RecordingToReplay)
+{
+	if (RecordingToReplay.SizeX != SizeX || RecordingToReplay.SizeY != SizeY || RecordingToReplay.BlockTypeSetName != BlockTypeSetName)
+	{
+		UE_LOG(LogMMGame, Error, TEXT("MMPlayGrid::StartReplay - Recording is for a %d x %d grid with block type set %s. Grid is %d x %d with %s."), 
+			RecordingToReplay.SizeX, RecordingToReplay.SizeY, *RecordingToReplay.BlockTypeSetName.ToString(), SizeX, SizeY, *BlockTypeSetName.ToString());
+		return false;
+	}
+	ReplayRecording = RecordingToReplay;
+	ReplayMoveIndex = 0;
+	StartPlayGrid();
+	return true;
+}
+
+
+bool AMMPlayGrid::StepReplay()
+{
+	if (!ReplayRecording.Moves.IsValidIndex(ReplayMoveIndex))
+	{
+		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::StepReplay - Replay finished after %d moves"), ReplayRecording.Moves.Num());
+		ReplayMoveIndex = INDEX_NONE;
+		return false;
+	}
+	const FMMRecordedMove& Move = ReplayRecording.Moves[ReplayMoveIndex++];
+	bool bMoved = false;
+	if (Move.bInstant) 
+	{
+		FMMInstantResolveResult Result;
+		bMoved = ResolveMoveInstant(Move.FromCoords, Move.ToCoords, Result, true);
+	}
+	else 
+	{
+		AMMPlayGridCell* FromCell = GetCell(Move.FromCoords);
+		AMMPlayGridCell* ToCell = GetCell(Move.ToCoords);
+		bMoved = FromCell && ToCell && MoveBlock(FromCell->CurrentBlock, ToCell);
+	}
+	if (!bMoved)
+	{
+		UE_LOG(LogMMGame, Error, TEXT("MMPlayGrid::StepReplay - Replayed move %d from %s to %s failed. The replay has diverged from the recording."), ReplayMoveIndex - 1, *Move.FromCoords.ToString(), *Move.ToCoords.ToString());
+		ReplayMoveIndex = INDEX_NONE;
+		return false;
+	}
+	return true;
+}
+
+
 int32 AMMPlayGrid::GetMinimumMatchSize()
 {
 	return MinimumMatchSize;
@@ -273,8 +498,7 @@ void AMMPlayGrid::SetMinimumMatchSize(const int32 NewMinimumMatchSize)
 bool AMMPlayGrid::SetBlockTypeSetName(const FName& NewBlockTypeSetName)
 {
 	BlockTypeSetName = NewBlockTypeSetName; 
-	// TODO: ? Check block type set name is valid. i.e. it is in GameMode's block type sets table.
-	return true;
+	return GetBlockTypeSetSampler() != nullptr;
 }
 
 
@@ -284,6 +508,18 @@ FName AMMPlayGrid::GetBlockTypeSetName()
 }
 
 
+FBlockTypeSetSampler* AMMPlayGrid::GetBlockTypeSetSampler()
+{
+	// BlockTypeSetName can also be assigned directly, so check the sampler still matches it.
+	if (!BlockTypeSetSampler.IsValid() || BlockTypeSetSampler->GetSetName() != BlockTypeSetName)
+	{
+		AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
+		BlockTypeSetSampler = GameMode ? GameMode->GetBlockTypeSetSampler(BlockTypeSetName) : nullptr;
+	}
+	return BlockTypeSetSampler.Get();
+}
+
+
 void AMMPlayGrid::AddPlayerMaxMoveCount(const int32 MovesToAdd)
 {
 	int32 ValidMovesToAdd = MovesToAdd;
@@ -326,6 +562,13 @@ void AMMPlayGrid::SpawnGrid()
 	// Destroy any existing grid
 	DestroyGrid();
 	InitBlocksFallingIntoGrid();
+	// Block size or margin may have changed since the last spawn.
+	BlockRescales.Empty();
+	Board.Init(SizeX, SizeY);
+	AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
+	if (GameMode) {
+		Board.SetBlockTypeRegistry(&GameMode->GetBlockTypeRegistry());
+	}
 
 	// Number of blocks
 	const int32 NumCells = SizeX * SizeY;
@@ -379,6 +622,7 @@ void AMMPlayGrid::SpawnGrid()
 			}
 			NewCell->AttachToActor(this, FAttachmentTransformRules::SnapToTargetIncludingScale);
 			NewCell->SetActorRelativeLocation(CellLocation, false, nullptr, ETeleportType::ResetPhysics);
+			AddCellBackgroundInstance(NewCell);
 			// Add it to our cell array
 			Cells.Add(NewCell);
 		}
@@ -386,6 +630,55 @@ void AMMPlayGrid::SpawnGrid()
 }
 
 
+void AMMPlayGrid::AddCellBackgroundInstance(AMMPlayGridCell* Cell)
+{
+	check(Cell);
+	Cell->BackgroundInstanceIndex = INDEX_NONE;
+	if (!bInstanceCellMeshes || Cell->GetCellMesh() == nullptr) {
+		return;
+	}
+	UStaticMesh* CellMesh = Cell->GetCellMesh()->GetStaticMesh();
+	if (CellBackgroundInstanceCells.Num() == 0)
+	{
+		CellBackgroundInstances->SetStaticMesh(CellMesh);
+		CellBackgroundInstances->SetMaterial(0, InstancedCellMaterial ? InstancedCellMaterial : Cell->BaseMaterial);
+	}
+	else if (CellBackgroundInstances->GetStaticMesh() != CellMesh)
+	{
+		UE_LOG(LogMMGame, Warning, TEXT("MMPlayGrid::AddCellBackgroundInstance - Cell at %s has a different mesh than the other cells. It will not be instanced."), *Cell->GetCoords().ToString());
+		return;
+	}
+	Cell->BackgroundInstanceIndex = CellBackgroundInstances->AddInstanceWorldSpace(Cell->GetCellMesh()->GetComponentTransform());
+	CellBackgroundInstanceCells.SetNum(FMath::Max(CellBackgroundInstanceCells.Num(), Cell->BackgroundInstanceIndex + 1));
+	CellBackgroundInstanceCells[Cell->BackgroundInstanceIndex] = Cell;
+	// The instance takes over drawing and clicks for the cell.
+	Cell->GetCellMesh()->SetVisibility(false);
+	Cell->GetCellMesh()->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+}
+
+
+bool AMMPlayGrid::HighlightCellInstance(const AMMPlayGridCell* Cell, const bool bOn)
+{
+	if (!bInstanceCellMeshes || Cell == nullptr) {
+		return false;
+	}
+	if (Cell->BackgroundInstanceIndex == INDEX_NONE || Cell->BackgroundInstanceIndex >= CellBackgroundInstances->GetInstanceCount()) {
+		return false;
+	}
+	CellBackgroundInstances->SetCustomDataValue(Cell->BackgroundInstanceIndex, 0, bOn ? 1.f : 0.f, true);
+	return true;
+}
+
+
+AMMPlayGridCell* AMMPlayGrid::GetCellForBackgroundHit(const FHitResult& Hit)
+{
+	if (Hit.Component.Get() != CellBackgroundInstances || !CellBackgroundInstanceCells.IsValidIndex(Hit.Item)) {
+		return nullptr;
+	}
+	return CellBackgroundInstanceCells[Hit.Item];
+}
+
+
 void AMMPlayGrid::FillGridBlocks()
 {
 	if (Cells.Num() == 0) {
@@ -404,31 +697,111 @@ void AMMPlayGrid::FillGridBlocks()
 		BlockContext.AddToCell = Cells[i];
 		AddRandomBlockInCell(BlockContext);
 	}
+	// Blocks were chosen to not make matches. Now make sure there is something the player can do.
+	if (!bPauseNewBlocks) {
+		EnsureValidMove();
+	}
 	GridLockedState = EMMGridLockState::Unchecked;
+	WakeGrid();
 	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::FillGridBlocks - Added %d blocks to grid"), Blocks.Num());
 }
 
 
+bool AMMPlayGrid::EnsureValidMove()
+{
+	const int32 MinMatchSize = GetMinimumMatchSize();
+	if (Board.UpdateMoveIndex(MinMatchSize) > 0) {
+		return true;
+	}
+	const FBlockTypeRegistry* Registry = Board.GetBlockTypeRegistry();
+	if (Registry == nullptr) {
+		return false;
+	}
+	const TArray<int16>& SpawnableTypeIds = GetSpawnableBlockTypeIds();
+	// Try changing one mobile cell at a time on a copy of the board. The copy's move index only re-evaluates the moves around the changed cell.
+	FMMBoard ScratchBoard = Board;
+	FAddBlockContext BlockContext;
+	for (int32 Index = 0; Index < ScratchBoard.Num(); Index++)
+	{
+		if (!ScratchBoard.IsMobile(Index)) {
+			continue;
+		}
+		const int16 OrigType = ScratchBoard.GetType(Index);
+		const EMMBoardCellFlags OrigFlags = ScratchBoard.GetFlags(Index);
+		// Forbid every type that would not give the grid a move, then let the normal weighted pickers choose from the rest.
+		BlockContext.ForbiddenBlockNames.Reset();
+		bool bAnyAllowed = false;
+		for (const int16 TypeId : SpawnableTypeIds)
+		{
+			bool bAllowed = false;
+			if (TypeId != OrigType && Registry->IsValidId(TypeId) && !Registry->IsImmobile(TypeId))
+			{
+				ScratchBoard.SetCell(Index, TypeId, OrigFlags);
+				// Any new match would include the changed cell, so only that cell needs checking.
+				bAllowed = !ScratchBoard.CellHasMatch(Index, MinMatchSize) && ScratchBoard.UpdateMoveIndex(MinMatchSize) > 0;
+			}
+			if (bAllowed) {
+				bAnyAllowed = true;
+			}
+			else {
+				BlockContext.ForbiddenBlockNames.Add(Registry->GetTypeName(TypeId));
+			}
+		}
+		ScratchBoard.SetCell(Index, OrigType, OrigFlags);
+		if (!bAnyAllowed) {
+			continue;
+		}
+		AMMPlayGridCell* Cell = GetCellByNumber(Index);
+		check(Cell);
+		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::EnsureValidMove - Grid has no valid move. Replacing block at %s"), *Cell->GetCoords().ToString());
+		if (IsValid(Cell->CurrentBlock))
+		{
+			OnRandomBlockRemoved(Cell->CurrentBlock);
+			ReleaseBlock(Cell->CurrentBlock);
+		}
+		// Only called while filling the grid, so this is still the initial fill.
+		BlockContext.AddToCell = Cell;
+		BlockContext.bPreventMatches = true;
+		BlockContext.bForInitialFill = true;
+		if (AddRandomBlockInCell(BlockContext) == nullptr)
+		{
+			UE_LOG(LogMMGame, Warning, TEXT("MMPlayGrid::EnsureValidMove - Could not add a replacement block at %s"), *Cell->GetCoords().ToString());
+			return false;
+		}
+		return Board.UpdateMoveIndex(MinMatchSize) > 0;
+	}
+	UE_LOG(LogMMGame, Warning, TEXT("MMPlayGrid::EnsureValidMove - Could not find a block change that gives the grid a valid move."));
+	return false;
+}
+
+
 void AMMPlayGrid::DestroyGrid()
 {
 	DestroyBlocks();
+	EmptyBlockPool();
 	for (AMMPlayGridCell* Cell : Cells)	{
 		Cell->DestroyCell();
 	}	
 	Cells.Empty();
+	CellBackgroundInstances->ClearInstances();
+	CellBackgroundInstanceCells.Empty();
 }
 
 
 void AMMPlayGrid::DestroyBlocks()
 {
-	for (AMMPlayGridCell* Cell : Cells)
+	// Includes blocks falling into the grid that are not in a cell yet.
+	for (int32 i = Blocks.Num() - 1; i >= 0; i--)
 	{
-		if (IsValid(Cell) && IsValid(Cell->CurrentBlock)) {
-			Cell->CurrentBlock->DestroyBlock();
+		if (IsValid(Blocks[i])) {
+			ReleaseBlock(Blocks[i]);
 		}
 	}
 	UnsettledBlocks.Empty();
 	BlocksToCheck.Empty();
+	for (UBlockMatch* BlockMatch : BlockMatches) {
+		ReleaseBlockMatch(BlockMatch);
+	}
 	BlockMatches.Empty();
 	BlocksToDestroy.Empty();
 	for (int32 i = 0; i < BlocksFallingIntoGrid.Num(); i++) {
@@ -438,6 +811,157 @@ void AMMPlayGrid::DestroyBlocks()
 }
 
 
+AMMBlock* AMMPlayGrid::AcquireBlock(TSubclassOf<AMMBlock> BlockClass)
+{
+	if (BlockClass == nullptr) {
+		return nullptr;
+	}
+	for (int32 i = BlockPool.Num() - 1; i >= 0; i--)
+	{
+		AMMBlock* PooledBlock = BlockPool[i];
+		if (IsValid(PooledBlock) && PooledBlock->GetClass() == BlockClass)
+		{
+			BlockPool.RemoveAtSwap(i, 1, false);
+			PooledBlock->ActivateBlock();
+			return PooledBlock;
+		}
+	}
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.Owner = this;
+	AMMBlock* NewBlock = GetWorld()->SpawnActor<AMMBlock>(BlockClass, FVector::ZeroVector, GetActorRotation(), SpawnParams);
+	if (NewBlock) {
+		NewBlock->SetGridSlot(FreeBlockSlots.Num() > 0 ? FreeBlockSlots.Pop(false) : NextBlockSlot++);
+	}
+	return NewBlock;
+}
+
+
+void AMMPlayGrid::ReleaseBlock(AMMBlock* Block)
+{
+	if (!IsValid(Block) || Block->IsPooled()) {
+		return;
+	}
+	if (SelectedBlock == Block)
+	{
+		if (SelectedBlock->Cell()) {
+			SelectedBlock->Cell()->Highlight(false);
+		}
+		SelectedBlock = nullptr;
+	}
+	if (Block->bFallingIntoGrid && Block->Cell() && BlocksFallingIntoGrid.Contains(Block->Cell()->X)) {
+		BlocksFallingIntoGrid[Block->Cell()->X].Blocks.RemoveSingle(Block);
+	}
+	Blocks.Remove(Block);
+	UnsettledBlocks.Remove(Block);
+	ToBeUnsettledBlocks.Remove(Block);
+	BlocksToCheck.Remove(Block);
+	RemoveBlockInstance(Block);
+	if (bPoolBlocks)
+	{
+		Block->DeactivateBlock();
+		BlockPool.Add(Block);
+	}
+	else 
+	{
+		FreeBlockSlots.Add(Block->GetGridSlot());
+		Block->DestroyBlock();
+	}
+}
+
+
+bool AMMPlayGrid::AddBlockInstance(AMMBlock* Block)
+{
+	check(Block);
+	UStaticMesh* Mesh = Block->GetBlockMesh() ? Block->GetBlockMesh()->GetStaticMesh() : nullptr;
+	if (Block->RenderInstanceComponent != nullptr)
+	{
+		if (Block->RenderInstanceComponent->GetStaticMesh() == Mesh) {
+			return true;
+		}
+		// The block's mesh has changed since it was instanced. Move it to the instances for its new mesh.
+		RemoveBlockInstance(Block);
+	}
+	if (Mesh == nullptr) {
+		return false;
+	}
+	FMMBlockInstanceSet& InstanceSet = BlockInstanceSets.FindOrAdd(Mesh);
+	if (!IsValid(InstanceSet.Component))
+	{
+		InstanceSet.Component = NewObject<UInstancedStaticMeshComponent>(this);
+		InstanceSet.Component->SetStaticMesh(Mesh);
+		InstanceSet.Component->SetMaterial(0, InstancedBlockMaterial ? InstancedBlockMaterial : Block->BaseMaterial);
+		InstanceSet.Component->NumCustomDataFloats = 5;
+		// Blocks keep their own collision for clicks.
+		InstanceSet.Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		InstanceSet.Component->SetupAttachment(SceneRoot);
+		InstanceSet.Component->RegisterComponent();
+		InstanceSet.FreeInstances.Empty();
+		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::AddBlockInstance - Created instanced mesh for %s"), *Mesh->GetName());
+	}
+	const FTransform InstanceTransform = Block->GetBlockMesh()->GetComponentTransform();
+	int32 InstanceIndex = INDEX_NONE;
+	if (InstanceSet.FreeInstances.Num() > 0) 
+	{
+		InstanceIndex = InstanceSet.FreeInstances.Pop(false);
+		InstanceSet.Component->UpdateInstanceTransform(InstanceIndex, InstanceTransform, true, true, true);
+	}
+	else {
+		InstanceIndex = InstanceSet.Component->AddInstanceWorldSpace(InstanceTransform);
+	}
+	Block->RenderInstanceComponent = InstanceSet.Component;
+	Block->RenderInstanceIndex = InstanceIndex;
+	Block->GetBlockMesh()->SetVisibility(false);
+	Block->GetBlockMesh()->TransformUpdated.AddUObject(this, &AMMPlayGrid::OnBlockMeshTransformUpdated);
+	Block->UpdateRenderInstanceData();
+	return true;
+}
+
+
+void AMMPlayGrid::RemoveBlockInstance(AMMBlock* Block)
+{
+	check(Block);
+	if (Block->RenderInstanceComponent == nullptr) {
+		return;
+	}
+	Block->GetBlockMesh()->TransformUpdated.RemoveAll(this);
+	// Instances are not removed since that would change the index of every later instance. Hide it and reuse it instead.
+	// Find the set by the instance component's mesh, since the block's own mesh may have changed since it was instanced.
+	FMMBlockInstanceSet* InstanceSet = BlockInstanceSets.Find(Block->RenderInstanceComponent->GetStaticMesh());
+	if (InstanceSet && InstanceSet->Component == Block->RenderInstanceComponent)
+	{
+		InstanceSet->Component->UpdateInstanceTransform(Block->RenderInstanceIndex, FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), false, true, true);
+		InstanceSet->FreeInstances.Add(Block->RenderInstanceIndex);
+	}
+	Block->RenderInstanceComponent = nullptr;
+	Block->RenderInstanceIndex = INDEX_NONE;
+	Block->GetBlockMesh()->SetVisibility(true);
+}
+
+
+void AMMPlayGrid::OnBlockMeshTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	AMMBlock* Block = UpdatedComponent ? Cast<AMMBlock>(UpdatedComponent->GetOwner()) : nullptr;
+	if (Block && Block->RenderInstanceComponent) {
+		Block->RenderInstanceComponent->UpdateInstanceTransform(Block->RenderInstanceIndex, UpdatedComponent->GetComponentTransform(), true, true, true);
+	}
+}
+
+
+void AMMPlayGrid::EmptyBlockPool()
+{
+	for (AMMBlock* PooledBlock : BlockPool)
+	{
+		if (IsValid(PooledBlock)) 
+		{
+			FreeBlockSlots.Add(PooledBlock->GetGridSlot());
+			PooledBlock->DestroyBlock();
+		}
+	}
+	BlockPool.Empty();
+}
+
+
 bool AMMPlayGrid::GetRandomBlockTypeNameForCell_Implementation(FName& FoundBlockTypeName, const FAddBlockContext& BlockContext)
 {
 	AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
@@ -453,17 +977,15 @@ bool AMMPlayGrid::GetRandomBlockTypeNameForCell_Implementation(FName& FoundBlock
 		return false;
 	}
 	// Check if we're going to going to prevent duplicates
-	if (FMath::FRandRange(0.f, 1.f) < DuplicateSpawnPreventionFactor) 
+	if (RandStream.FRandRange(0.f, 1.f) < DuplicateSpawnPreventionFactor) 
 	{
 		// For duplicate block prevention use the existing BlockContext. It contains dupe-prevention info.
 		return GameMode->GetRandomBlockTypeNameForCell(FoundBlockTypeName, BlockContext);
 	}
 	else 
 	{
-		// If we are not preventing duplicates, create a new copy of the BlockContext and empty out the ExcludedBockNames.
-		FAddBlockContext TmpContext = BlockContext;
-		TmpContext.ExcludedBlockNames.Empty();
-		return GameMode->GetRandomBlockTypeNameForCell(FoundBlockTypeName, TmpContext);
+		// If we are not preventing duplicates, ignore the ExcludedBlockNames. ForbiddenBlockNames are kept.
+		return GameMode->GetRandomBlockTypeNameForCell(FoundBlockTypeName, BlockContext, false);
 	}
 
 }
@@ -490,53 +1012,33 @@ AMMBlock* AMMPlayGrid::AddBlockInCell(const FName& BlockTypeName, const FAddBloc
 		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::AddBlockInCell - Dropping block %0.f units above column %d."), BlockContext.OffsetAboveTopCell, Cell->GetCoords().X);
 	}
 	FVector BlockLocation = Cell->GetBlockLocalLocation() + FVector(0.f, 0.f, BlockContext.OffsetAboveTopCell);
-	FActorSpawnParameters SpawnParams;
-	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
-	SpawnParams.Owner = this;
-	FBlockType BlockType;
-	FVector Rescale = FVector::OneVector;
-	if (GameMode->GetBlockTypeByName(BlockTypeName, BlockType))
-	{
-		TSubclassOf<AMMBlock> BlockClass = BlockType.BlockClass.LoadSynchronous();
-		AMMBlock* NewBlock = GetWorld()->SpawnActor<AMMBlock>(
-			BlockClass, 
-			FVector::ZeroVector, 
-			GetActorRotation(), 
-			SpawnParams
-		);
+	const FBlockType* BlockType = GameMode->GetBlockTypeByName(BlockTypeName);
+	if (BlockType)
+	{
+		AMMBlock* NewBlock = AcquireBlock(GameMode->GetLoadedBlockClass(*BlockType));
 		if (NewBlock)
 		{
 			NewBlock->ChangeOwningGridCell(Cell);
 			Blocks.Add(NewBlock);
-			NewBlock->SetBlockType(BlockType);
+			NewBlock->SetBlockType(*BlockType);
 			NewBlock->bFallingIntoGrid = BlockContext.OffsetAboveTopCell > 0.f;
-			if (bScaleBlocks)
-			{
-				FVector BlockOrigin;
-				FVector BlockBoxExtent;
-				float BlockSphereRadius;
-				UKismetSystemLibrary::GetComponentBounds(NewBlock->GetBlockMesh(), BlockOrigin, BlockBoxExtent, BlockSphereRadius);
-				if (BlockBoxExtent.X > 0.f) {
-					Rescale.X = (BlockSize.X - (BlockMargin * 2)) / (BlockBoxExtent.X * 2);
-				}
-				if (BlockBoxExtent.Z > 0.f) {
-					Rescale.Z = (BlockSize.Z - (BlockMargin * 2)) / (BlockBoxExtent.Z * 2);
-				}
-				// Scale by smallest X or Z, ignore Y
-				Rescale = Rescale.X < Rescale.Z ? Rescale.X * FVector::OneVector : Rescale.Z * FVector::OneVector;
-				NewBlock->GetBlockMesh()->SetWorldScale3D(NewBlock->GetBlockMesh()->GetRelativeScale3D() * Rescale);
+			if (bScaleBlocks) {
+				NewBlock->GetBlockMesh()->SetWorldScale3D(NewBlock->GetBlockMesh()->GetRelativeScale3D() * GetBlockRescale(NewBlock));
 			}
 			NewBlock->AttachToActor(this, FAttachmentTransformRules::SnapToTargetIncludingScale);
 			NewBlock->SetActorRelativeLocation(BlockLocation, false, nullptr, ETeleportType::ResetPhysics);
+			if (bInstanceBlockMeshes) {
+				AddBlockInstance(NewBlock);
+			}
 			// Don't unsettle if this is intial grid fill
-			if (!BlockContext.bForInitialFill && !BlockContext.bPreventMatches)
+			if (!BlockContext.bForInitialFill && !BlockContext.bPreventMatches && !BlockContext.bAlreadySettled)
 			{
 				AMMPlayGridCell* TopCell = GetTopCell(Cell->X);
 				if (!NewBlock->bFallingIntoGrid || (!IsValid(TopCell->CurrentBlock) || TopCell->CurrentBlock == NewBlock)) 
 				{
-					ToBeUnsettledBlocks.AddUnique(NewBlock);
+					ToBeUnsettledBlocks.Add(NewBlock);
 					if (!NewBlock->bFallingIntoGrid) {
-						BlocksToCheck.AddUnique(NewBlock);
+						BlocksToCheck.Add(NewBlock);
 					}
 				}
 			}
@@ -555,6 +1057,34 @@ AMMBlock* AMMPlayGrid::AddBlockInCell(const FName& BlockTypeName, const FAddBloc
 }
 
 
+FVector AMMPlayGrid::GetBlockRescale(AMMBlock* Block)
+{
+	check(Block);
+	// SetBlockType has already run, so this is the mesh for the block's type. Blueprints may pick a different mesh for each type.
+	const TPair<const UClass*, const UStaticMesh*> RescaleKey(Block->GetClass(), Block->GetBlockMesh()->GetStaticMesh());
+	const FVector* FoundRescale = BlockRescales.Find(RescaleKey);
+	if (FoundRescale) {
+		return *FoundRescale;
+	}
+	// New and pooled blocks both start with their class default mesh scale, so the measured bounds are the same for every block of a class with the same mesh.
+	FVector Rescale = FVector::OneVector;
+	FVector BlockOrigin;
+	FVector BlockBoxExtent;
+	float BlockSphereRadius;
+	UKismetSystemLibrary::GetComponentBounds(Block->GetBlockMesh(), BlockOrigin, BlockBoxExtent, BlockSphereRadius);
+	if (BlockBoxExtent.X > 0.f) {
+		Rescale.X = (BlockSize.X - (BlockMargin * 2)) / (BlockBoxExtent.X * 2);
+	}
+	if (BlockBoxExtent.Z > 0.f) {
+		Rescale.Z = (BlockSize.Z - (BlockMargin * 2)) / (BlockBoxExtent.Z * 2);
+	}
+	// Scale by smallest X or Z, ignore Y
+	Rescale = Rescale.X < Rescale.Z ? Rescale.X * FVector::OneVector : Rescale.Z * FVector::OneVector;
+	BlockRescales.Add(RescaleKey, Rescale);
+	return Rescale;
+}
+
+
 AMMBlock* AMMPlayGrid::AddRandomBlockInCell(const FAddBlockContext& BlockContext)
 {
 	if (bPauseNewBlocks) {
@@ -564,73 +1094,116 @@ AMMBlock* AMMPlayGrid::AddRandomBlockInCell(const FAddBlockContext& BlockContext
 	check(Cell);
 	AMMBlock* NewBlock = nullptr;
 	FName BlockTypeName;
-	bool bTryAgain = true;
+	// Pick with the given context unless we need to add names to it. Then use RandomBlockContext, which keeps its allocations.
+	const FAddBlockContext* PickContext = &BlockContext;
+	// If we are preventing matches, forbid the block types that would make a match in this cell before any block is spawned.
+	// Blocks falling into the grid are not in their cell yet, so they can't make a match.
+	const FBlockTypeRegistry* Registry = Board.GetBlockTypeRegistry();
+	const bool bCheckMatches = BlockContext.bPreventMatches && BlockContext.OffsetAboveTopCell <= 0.f && Registry && Board.IsValidCoords(Cell->GetCoords());
+	if (bCheckMatches)
+	{
+		Board.GetTypesCompletingRun(Board.ToIndex(Cell->GetCoords()), GetMinimumMatchSize(), GetSpawnableBlockTypeIds(), CompletingRunTypeIds);
+		if (CompletingRunTypeIds.Contains(true))
+		{
+			SetRandomBlockContext(BlockContext);
+			for (TConstSetBitIterator<> It(CompletingRunTypeIds); It; ++It) {
+				RandomBlockContext.ForbiddenBlockNames.AddUnique(Registry->GetTypeName((int16)It.GetIndex()));
+			}
+			PickContext = &RandomBlockContext;
+			UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::AddRandomBlockInCell - Forbidding block types that would match in cell %s"), *Cell->GetCoords().ToString());
+		}
+	}
+	// The native pickers never return a forbidden type, but a Blueprint override may only know about ExcludedBlockNames.
+	// Retry with the forbidden types also excluded, then fall back to an unweighted pick from the grid's block type set.
 	const int32 MaxTries = 50;
-	int32 Tries = 0;
-	// Use a copy of the context because we may add names to the ExcludedBlockNames list
-	FAddBlockContext TmpBlockContext = BlockContext;
-	while (bTryAgain && Tries < MaxTries)
-	{
-		Tries++;
-		bTryAgain = false;
-		if (GetRandomBlockTypeNameForCell(BlockTypeName, TmpBlockContext))
+	bool bFoundType = false;
+	for (int32 Tries = 0; Tries < MaxTries && !bFoundType; Tries++)
+	{
+		if (!GetRandomBlockTypeNameForCell(BlockTypeName, *PickContext)) {
+			return nullptr;
+		}
+		bFoundType = !PickContext->ForbiddenBlockNames.Contains(BlockTypeName);
+		if (!bFoundType && Tries == 0)
 		{
-			// AddBlockInCell should not do unsettling if we are preventing matches or this is initial fill. 
-			// If we are preventing matches, we will unsettle the cell here if the block was added successfully without matching.
-			NewBlock = AddBlockInCell(BlockTypeName, TmpBlockContext);
-			if (IsValid(NewBlock))
+			if (PickContext != &RandomBlockContext) 
 			{
-				// If we are preventing matches, check the new block to see if it created a match.
-				if (BlockContext.bPreventMatches && !NewBlock->bFallingIntoGrid)
-				{
-					UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("Checking new block for matches %s"), *NewBlock->GetCoords().ToString());
-					UBlockMatch* BlockMatchHoriz = nullptr;
-					UBlockMatch* BlockMatchVert = nullptr;
-					if (CheckForMatches(NewBlock, &BlockMatchHoriz, &BlockMatchVert, false))
-					{
-						// A match was found.
-						UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("   New block matches"));
-						// Add the block's name to the excluded block names list
-						TmpBlockContext.ExcludedBlockNames.Add(NewBlock->GetBlockType().Name);
-						// Cleanup and destroy new block
-						Blocks.RemoveSingle(NewBlock);
-						BlocksToCheck.RemoveSingle(NewBlock);
-						ToBeUnsettledBlocks.RemoveSingle(NewBlock);
-						UnsettledBlocks.RemoveSingle(NewBlock);
-						NewBlock->DestroyBlock();
-						bTryAgain = true;
-						NewBlock = nullptr;
-						if (Tries == MaxTries) {
-							UE_CLOG(bDebugLog, LogMMGame, Warning, TEXT("MMPlayGrid::AddRandomBlockInCell - Exceeded max tries to find an unmatching block type in cell %s"), *Cell->GetCoords().ToString());
-						}
-					}
-					else 
-					{
-						// Block was added with no match. Then queue block to be unsettled if unsettling is allowed.
-						if (!BlockContext.bForInitialFill)
-						{
-							AMMPlayGridCell* TopCell = GetTopCell(Cell->X);
-							if (!NewBlock->bFallingIntoGrid || (!IsValid(TopCell->CurrentBlock) || TopCell->CurrentBlock == NewBlock)) 
-							{
-								ToBeUnsettledBlocks.AddUnique(NewBlock);
-								if (!NewBlock->bFallingIntoGrid) {
-									BlocksToCheck.AddUnique(NewBlock);
-								}
-							}
-						}
-					}
-				}
+				SetRandomBlockContext(BlockContext);
+				PickContext = &RandomBlockContext;
 			}
-			else
-			{
-				NewBlock = nullptr;
+			for (const FName& ForbiddenName : RandomBlockContext.ForbiddenBlockNames) {
+				RandomBlockContext.ExcludedBlockNames.AddUnique(ForbiddenName);
 			}
 		}
 	}
+	if (!bFoundType)
+	{
+		// Same immobile rule as the game mode's picker
+		const bool bPreventImmobile = BlockContext.OffsetAboveTopCell > 0.f || Cell->GetCoords().Y >= (SizeY - 2);
+		FBlockTypeSetSampler* Sampler = GetBlockTypeSetSampler();
+		BlockTypeName = Sampler ? Sampler->PickFallback(PickContext->ForbiddenBlockNames, bPreventImmobile, RandStream) : NAME_None;
+		if (BlockTypeName.IsNone())
+		{
+			UE_LOG(LogMMGame, Warning, TEXT("MMPlayGrid::AddRandomBlockInCell - Exceeded max tries to find an unmatching block type in cell %s"), *Cell->GetCoords().ToString());
+			return nullptr;
+		}
+		UE_CLOG(bDebugLog, LogMMGame, Warning, TEXT("MMPlayGrid::AddRandomBlockInCell - Exceeded max tries to find an unmatching block type in cell %s, using %s"), *Cell->GetCoords().ToString(), *BlockTypeName.ToString());
+	}
+	// AddBlockInCell does not do unsettling if we are preventing matches or this is initial fill. 
+	// If we are preventing matches, we unsettle the cell here.
+	NewBlock = AddBlockInCell(BlockTypeName, BlockContext);
+	if (!IsValid(NewBlock)) {
+		return nullptr;
+	}
+	if (BlockContext.bPreventMatches && !NewBlock->bFallingIntoGrid && !BlockContext.bForInitialFill)
+	{
+		// Queue block to be unsettled
+		AMMPlayGridCell* TopCell = GetTopCell(Cell->X);
+		if (!NewBlock->bFallingIntoGrid || (!IsValid(TopCell->CurrentBlock) || TopCell->CurrentBlock == NewBlock)) 
+		{
+			ToBeUnsettledBlocks.Add(NewBlock);
+			if (!NewBlock->bFallingIntoGrid) {
+				BlocksToCheck.Add(NewBlock);
+			}
+		}
+	}
+	OnRandomBlockTypeAdded(NewBlock->GetBlockType(), NewBlock);
 	return NewBlock;
 }
 
 
+void AMMPlayGrid::OnRandomBlockTypeAdded(const FBlockType& BlockType, AMMBlock* NewBlock)
+{
+}
+
+
+void AMMPlayGrid::OnRandomBlockRemoved(AMMBlock* Block)
+{
+}
+
+
+void AMMPlayGrid::SetRandomBlockContext(const FAddBlockContext& BlockContext)
+{
+	// Copy the names into the existing arrays rather than assigning the whole struct, so the arrays keep their allocations.
+	RandomBlockContext.AddToCell = BlockContext.AddToCell;
+	RandomBlockContext.OffsetAboveTopCell = BlockContext.OffsetAboveTopCell;
+	RandomBlockContext.bPreventMatches = BlockContext.bPreventMatches;
+	RandomBlockContext.bForInitialFill = BlockContext.bForInitialFill;
+	RandomBlockContext.bAlreadySettled = BlockContext.bAlreadySettled;
+	RandomBlockContext.ExcludedBlockNames.Reset();
+	RandomBlockContext.ExcludedBlockNames.Append(BlockContext.ExcludedBlockNames);
+	RandomBlockContext.ForbiddenBlockNames.Reset();
+	RandomBlockContext.ForbiddenBlockNames.Append(BlockContext.ForbiddenBlockNames);
+}
+
+
+const TArray<int16>& AMMPlayGrid::GetSpawnableBlockTypeIds()
+{
+	static const TArray<int16> NoTypeIds;
+	FBlockTypeSetSampler* Sampler = GetBlockTypeSetSampler();
+	return Sampler ? Sampler->GetTypeIds() : NoTypeIds;
+}
+
+
 AMMBlock* AMMPlayGrid::DropRandomBlockInColumn(UPARAM(ref) AMMPlayGridCell* Cell)
 {
 	if (bPauseNewBlocks) {
@@ -688,18 +1261,16 @@ AMMBlock* AMMPlayGrid::DropRandomBlockInColumn(UPARAM(ref) AMMPlayGridCell* Cell
 	AMMBlock* FirstNewBlock = nullptr;
 	AMMBlock* LastBlock = TopBlock;
 	int32 LastBlockMatches = 0;
-	TArray<FName> ExcludedBlockNames;
+	// One context for the whole column, so its ExcludedBlockNames keeps its allocation.
+	FAddBlockContext BlockContext;
+	BlockContext.AddToCell = TopCell;
+	TArray<FName>& ExcludedBlockNames = BlockContext.ExcludedBlockNames;
 	for (int32 i = 0; i < OpenCellCount; i++)
 	{		
-		FAddBlockContext BlockContext;
-		BlockContext.AddToCell = TopCell;
 		BlockContext.OffsetAboveTopCell = (
 			(GetActorTransform().GetScale3D().Z * NewBlockDropInHeight) +
 			((BlockSize.Z + CellBackgroundMargin) * (BlocksFallingIntoGrid[Column].Blocks.Num() + 1))
 		);
-		if (ExcludedBlockNames.Num() > 0) {
-			BlockContext.ExcludedBlockNames = ExcludedBlockNames;
-		}
 		AMMBlock* NewBlock = AddRandomBlockInCell(BlockContext);
 		if (IsValid(NewBlock)) {
 			if (FirstNewBlock == nullptr) {
@@ -714,7 +1285,7 @@ AMMBlock* AMMPlayGrid::DropRandomBlockInColumn(UPARAM(ref) AMMPlayGridCell* Cell
 				}
 				else {
 					LastBlockMatches = 0;
-					ExcludedBlockNames.Empty();
+					ExcludedBlockNames.Reset();
 				}
 				// If we have added blocks that match, make sure they don't reach enough matches to trigger an actual match group.
 				if (LastBlockMatches >= GetMinimumMatchSize() - 1) 
@@ -733,59 +1304,72 @@ AMMBlock* AMMPlayGrid::DropRandomBlockInColumn(UPARAM(ref) AMMPlayGridCell* Cell
 void AMMPlayGrid::CellBecameOpen(AMMPlayGridCell* Cell)
 {
 	check(Cell);
-	if (IsValid(Cell->CurrentBlock)) { return; }
-	AMMBlock* FoundBlock = nullptr;
-	bool bDoUnsettle = false;
-	FIntPoint Coords = Cell->GetCoords();
-	// If the cell is one of the top cells of a column
-	if (Coords.Y == SizeY - 1)
-	{
-		for (int32 i = 0; i < BlocksFallingIntoGrid[Coords.X].Blocks.Num(); i++)
+	if (IsValid(Cell->CurrentBlock) || bPlanningSettle) { return; }
+	if (ColumnsToSettle.Num() != SizeX) {
+		ColumnsToSettle.Init(false, SizeX);
+	}
+	ColumnsToSettle[Cell->X] = true;
+}
+
+
+void AMMPlayGrid::PlanColumnSettles()
+{
+	for (TConstSetBitIterator<> It(ColumnsToSettle); It; ++It) {
+		PlanColumnSettle(It.GetIndex());
+	}
+	ColumnsToSettle.Init(false, SizeX);
+}
+
+
+void AMMPlayGrid::PlanColumnSettle(const int32 Column)
+{
+	if (!BlocksFallingIntoGrid.Contains(Column)) {
+		return;
+	}
+	TGuardValue<bool> PlanningGuard(bPlanningSettle, true);
+	int32 SettleCount = 0;
+	// Lowest cell the next mobile block in the column can settle to.
+	int32 LandingY = 0;
+	for (int32 Y = 0; Y < SizeY; Y++)
+	{
+		AMMPlayGridCell* Cell = GetCell(FIntPoint(Column, Y));
+		AMMBlock* Block = Cell ? Cell->CurrentBlock : nullptr;
+		if (!IsValid(Block) || Block->bFallingIntoGrid) {
+			continue;
+		}
+		if (!Block->CanMove() || Block->IsMatched())
 		{
-			AMMBlock* FallingBlock = BlocksFallingIntoGrid[Coords.X].Blocks[i];
-			if (FallingBlock->SettleToGridCell == Cell)
-			{
-				FoundBlock = FallingBlock;
-				bDoUnsettle = true;
-				break;
-			}
+			// Blocks above this one land on it.
+			LandingY = Y + 1;
+			continue;
 		}
-	}	
-	if (FoundBlock == nullptr)
-	{
-		// See if we can find this cell in our current UnsettledBlocks list
-		for (AMMBlock* Block : UnsettledBlocks)
+		if (LandingY != Y)
 		{
-			if (Block->SettleToGridCell == Cell)
-			{	
-				// Found the block but it is alreay in UnsettledBlock list, so don't set bDoUnsettle flag
-				FoundBlock = Block;
-				break;
+			Block->ChangeOwningGridCell(GetCell(FIntPoint(Column, LandingY)));
+			if (!Block->bUnsettled) {
+				ToBeUnsettledBlocks.Add(Block);
 			}
+			SettleCount++;
 		}
+		LandingY++;
 	}
-	if (FoundBlock == nullptr)
+	// Blocks falling into the grid take the open cells at the top of the column.
+	for (AMMBlock* FallingBlock : BlocksFallingIntoGrid[Column].Blocks)
 	{
-		// See if we find the cell in the ToBeUnsettled list
-		for (AMMBlock* Block : ToBeUnsettledBlocks)
-		{
-			if (Block->SettleToGridCell == Cell)
-			{
-				FoundBlock = Block;
-				bDoUnsettle = true;
-				break;
-			}
+		if (LandingY >= SizeY) {
+			break;
 		}
-	}
-	if (FoundBlock) {
-		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("AMMPlayGrid::CellBecameOpen - Found new block %s for cell at %s"), *FoundBlock->GetName(), *Cell->GetCoords().ToString());
-		if (!FoundBlock->ChangeOwningGridCell(Cell)) {
-			UE_LOG(LogMMGame, Error, TEXT("AMMPlayGrid::CellBecameOpen - Tried to set change owner of block %s to cell %s but could not."), *FoundBlock->GetName(), *Cell->GetCoords().ToString());
+		AMMPlayGridCell* LandingCell = GetCell(FIntPoint(Column, LandingY));
+		if (FallingBlock->OwningGridCell != LandingCell) {
+			FallingBlock->ChangeOwningGridCell(LandingCell);
 		}
+		if (!FallingBlock->bUnsettled) {
+			ToBeUnsettledBlocks.Add(FallingBlock);
+		}
+		SettleCount++;
+		LandingY++;
 	}
-	if (FoundBlock == nullptr || (FoundBlock && bDoUnsettle)) {
-		UnsettleBlockAboveCell(Cell);
-	}
+	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::PlanColumnSettle - Column %d has %d blocks to settle"), Column, SettleCount);
 }
 
 
@@ -847,24 +1431,108 @@ TArray<AMMPlayGridCell*> AMMPlayGrid::GetCellNeighbors(const AMMPlayGridCell* Ce
 			Neighbors.Add(Neighbor);
 		}
 	}
-	return Neighbors;
-}
-
-
-AMMPlayGridCell* AMMPlayGrid::GetTopCell(const int32 Column)
-{
-	if (Column > SizeX - 1) { return nullptr; }
-	return GetCell(FIntPoint(Column, SizeY - 1));
+	return Neighbors;
+}
+
+
+void AMMPlayGrid::GetMatchNeighbors(UBlockMatch* Match, TArray<AMMPlayGridCell*>& OutNeighbors, const bool bIncludeDiagonal)
+{
+	if (Match == nullptr || Match->Blocks.Num() == 0) {
+		return;
+	}
+	if (!FMMBitBoard::SupportsSize(SizeX, SizeY)) 
+	{
+		OutNeighbors.Append(Match->GetCellNeighbors(bIncludeDiagonal));
+		return;
+	}
+	Match->Sort();
+	FMMBitBoard MatchMask(SizeX, SizeY);
+	MatchMask.SetLine(Match->StartCoords, Match->Orientation, Match->Blocks.Num());
+	TArray<FIntPoint> NeighborCoords;
+	MatchMask.Neighbors(bIncludeDiagonal).GetSetCoords(NeighborCoords);
+	for (const FIntPoint& Coords : NeighborCoords)
+	{
+		AMMPlayGridCell* Neighbor = GetCell(Coords);
+		if (IsValid(Neighbor)) {
+			OutNeighbors.Add(Neighbor);
+		}
+	}
+}
+
+
+AMMPlayGridCell* AMMPlayGrid::GetTopCell(const int32 Column)
+{
+	if (Column > SizeX - 1) { return nullptr; }
+	return GetCell(FIntPoint(Column, SizeY - 1));
+}
+
+
+AMMBlock* AMMPlayGrid::GetBlock(const FIntPoint& Coords)
+{
+	AMMPlayGridCell* Cell = GetCell(Coords);
+	if (Cell != nullptr) {
+		return Cell->CurrentBlock;
+	}
+	return nullptr;
+}
+
+
+void AMMPlayGrid::SyncBoard()
+{
+	if (Board.GetSizeX() != SizeX || Board.GetSizeY() != SizeY) {
+		Board.Init(SizeX, SizeY);
+	}
+	else {
+		Board.Reset();
+	}
+	AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
+	if (GameMode) {
+		Board.SetBlockTypeRegistry(&GameMode->GetBlockTypeRegistry());
+	}
+	for (AMMPlayGridCell* Cell : Cells) {
+		SyncBoardCell(Cell);
+	}
+}
+
+
+void AMMPlayGrid::SyncBoardCell(const AMMPlayGridCell* Cell)
+{
+	if (Cell == nullptr || !Board.IsValidCoords(Cell->GetCoords())) {
+		return;
+	}
+	const int32 Index = Board.ToIndex(Cell->GetCoords());
+	const AMMBlock* Block = Cell->CurrentBlock;
+	if (!IsValid(Block)) 
+	{
+		Board.ClearCell(Index);
+		return;
+	}
+	EMMBoardCellFlags CellFlags = EMMBoardCellFlags::None;
+	if (!Block->CanMove()) {
+		CellFlags |= EMMBoardCellFlags::Immobile;
+	}
+	if (Block->IsIndestructible()) {
+		CellFlags |= EMMBoardCellFlags::Indestructible;
+	}
+	if (Block->bMatchedHorizontal) {
+		CellFlags |= EMMBoardCellFlags::MatchedHorizontal;
+	}
+	if (Block->bMatchedVertical) {
+		CellFlags |= EMMBoardCellFlags::MatchedVertical;
+	}
+	if (Block->bUnsettled || Block->BlockState == EMMGridState::Moving || Block->BlockState == EMMGridState::Settling) {
+		CellFlags |= EMMBoardCellFlags::Unsettled;
+	}
+	// Blocks with types unknown to the registry have no id and can't match anything, so the board treats them as empty.
+	Board.SetCell(Index, Block->GetBlockTypeId(), CellFlags);
 }
 
 
-AMMBlock* AMMPlayGrid::GetBlock(const FIntPoint& Coords)
+void AMMPlayGrid::SyncBoardBlock(const AMMBlock* Block)
 {
-	AMMPlayGridCell* Cell = GetCell(Coords);
-	if (Cell != nullptr) {
-		return Cell->CurrentBlock;
+	if (IsValid(Block) && Block->OwningGridCell && Block->OwningGridCell->CurrentBlock == Block) {
+		SyncBoardCell(Block->OwningGridCell);
 	}
-	return nullptr;
 }
 
 
@@ -1075,6 +1743,35 @@ void AMMPlayGrid::OnFingerPressedToggleBlocks(ETouchIndex::Type FingerIndex, UPr
 }
 
 
+void AMMPlayGrid::CellBackgroundClicked(UPrimitiveComponent* ClickedComp, FKey ButtonClicked)
+{
+	// The click event doesn't say which instance was clicked, so find it with the same trace the click used.
+	APlayerController* PC = UGameplayStatics::GetPlayerController(GetWorld(), 0);
+	FHitResult Hit;
+	if (PC && PC->GetHitResultUnderCursor(PC->CurrentClickTraceChannel, false, Hit))
+	{
+		AMMPlayGridCell* Cell = GetCellForBackgroundHit(Hit);
+		if (Cell) {
+			CellClicked(Cell);
+		}
+	}
+}
+
+
+void AMMPlayGrid::OnFingerPressedCellBackground(ETouchIndex::Type FingerIndex, UPrimitiveComponent* TouchedComponent)
+{
+	APlayerController* PC = UGameplayStatics::GetPlayerController(GetWorld(), 0);
+	FHitResult Hit;
+	if (PC && PC->GetHitResultUnderFinger(FingerIndex, PC->CurrentClickTraceChannel, false, Hit))
+	{
+		AMMPlayGridCell* Cell = GetCellForBackgroundHit(Hit);
+		if (Cell) {
+			CellClicked(Cell);
+		}
+	}
+}
+
+
 bool AMMPlayGrid::MoveBlock(AMMBlock* MovingBlock, AMMPlayGridCell* ToCell)
 {
 	if (MovingBlock == nullptr || ToCell == nullptr || MovingBlock->OwningGridCell == nullptr) {
@@ -1104,50 +1801,35 @@ bool AMMPlayGrid::MoveBlock(AMMBlock* MovingBlock, AMMPlayGridCell* ToCell)
 	}
 	// Set grid state
 	GridState = EMMGridState::Moving;
+	WakeGrid();
 	// Swap the blocks
-	ToCell->CurrentBlock = MovingBlock;
+	ToCell->SetCurrentBlock(MovingBlock);
 	MovingBlock->OwningGridCell = ToCell;
-	FromCell->CurrentBlock = nullptr;
+	FromCell->SetCurrentBlock(nullptr);
 	if (SwappingBlock)
 	{
-		FromCell->CurrentBlock = SwappingBlock;
+		FromCell->SetCurrentBlock(SwappingBlock);
 		SwappingBlock->OwningGridCell = FromCell;
 	}
-	// Check for matches on moved block
-	UBlockMatch* BlockMatchHoriz = nullptr;
-	UBlockMatch* BlockMatchVert = nullptr;
-	CheckForMatches(MovingBlock, &BlockMatchHoriz, &BlockMatchVert);
-	if (BlockMatchHoriz && BlockMatchHoriz->Blocks.Num() > 0) {
-		CurrentMatches.Add(BlockMatchHoriz);
-	}
-	if (BlockMatchVert && BlockMatchVert->Blocks.Num() > 0) {
-		CurrentMatches.Add(BlockMatchVert);
-	}
-	// Check for matches on swapped block
-	if (IsValid(SwappingBlock) && !(SwappingBlock->bMatchedHorizontal && SwappingBlock->bMatchedVertical))
-	{
-		UBlockMatch* SwapBlockMatchHoriz = nullptr;
-		UBlockMatch* SwapBlockMatchVert = nullptr;
-		CheckForMatches(SwappingBlock, &SwapBlockMatchHoriz, &SwapBlockMatchVert);
-		if (SwapBlockMatchHoriz && SwapBlockMatchHoriz->Blocks.Num() > 0) {
-			CurrentMatches.Add(SwapBlockMatchHoriz);
-		}
-		if (SwapBlockMatchVert && SwapBlockMatchVert->Blocks.Num() > 0) {
-			CurrentMatches.Add(SwapBlockMatchVert);
-		}
+	// Check for matches on moved and swapped blocks
+	TArray<AMMBlock*> MovedBlocks;
+	MovedBlocks.Add(MovingBlock);
+	if (IsValid(SwappingBlock)) {
+		MovedBlocks.Add(SwappingBlock);
 	}
+	FindMatchesForBlocks(MovedBlocks, CurrentMatches);
 	if (CurrentMatches.Num() == 0)
 	{
 		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("  MoveBlock %s no matches for move to %s"), *MovingBlock->GetName(), *ToCell->GetCoords().ToString());
 		// No matches, swap the blocks back to orignal spots
 		PlaySoundQueue.AddUnique(MoveFailSound.Get());
-		FromCell->CurrentBlock = MovingBlock;
+		FromCell->SetCurrentBlock(MovingBlock);
 		MovingBlock->OwningGridCell = FromCell;
 		MovingBlock->OnMoveFail(ToCell);
-		ToCell->CurrentBlock = nullptr;
+		ToCell->SetCurrentBlock(nullptr);
 		if (SwappingBlock)
 		{
-			ToCell->CurrentBlock = SwappingBlock;
+			ToCell->SetCurrentBlock(SwappingBlock);
 			SwappingBlock->OwningGridCell = ToCell;
 			SwappingBlock->OnMoveFail(FromCell);
 		}
@@ -1159,10 +1841,10 @@ bool AMMPlayGrid::MoveBlock(AMMBlock* MovingBlock, AMMPlayGridCell* ToCell)
 		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("  MoveBlock %s block moved to to %s"), *MovingBlock->GetName(), *ToCell->GetCoords().ToString());
 		GridLockedState = EMMGridLockState::Unchecked;
 		MovingBlock->bMovedByPlayer = true;
-		UnsettledBlocks.AddUnique(MovingBlock);
+		UnsettledBlocks.Add(MovingBlock);
 		MovingBlock->OnMove(ToCell);
 		if (SwappingBlock) {
-			UnsettledBlocks.AddUnique(SwappingBlock);
+			UnsettledBlocks.Add(SwappingBlock);
 			SwappingBlock->OnMove(FromCell);
 		}
 		else
@@ -1171,11 +1853,15 @@ bool AMMPlayGrid::MoveBlock(AMMBlock* MovingBlock, AMMPlayGridCell* ToCell)
 			CellBecameOpen(FromCell);
 			// And we also need to drop an extra block into this column since the column lost one.
 			DropRandomBlockInColumn(FromCell);
+			PlanColumnSettles();
 		}
 		BlockMatches.Append(CurrentMatches);
 		SortMatches();
 		IncrementPlayerMoveTurn();
 		bAllMatchesFinished = false;
+		FMMRecordedMove& RecordedMove = Recording.Moves.AddDefaulted_GetRef();
+		RecordedMove.FromCoords = FromCell->GetCoords();
+		RecordedMove.ToCoords = ToCell->GetCoords();
 	}
 	// TODO: Remove this debug
 	DebugBlocks(FString("MoveBlock"));
@@ -1183,6 +1869,175 @@ bool AMMPlayGrid::MoveBlock(AMMBlock* MovingBlock, AMMPlayGridCell* ToCell)
 }
 
 
+bool AMMPlayGrid::ResolveMoveInstant(const FIntPoint& FromCoords, const FIntPoint& ToCoords, FMMInstantResolveResult& Result, const bool bApplyToGrid)
+{
+	Result = FMMInstantResolveResult();
+	AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
+	const FBlockTypeRegistry* Registry = Board.GetBlockTypeRegistry();
+	if (GameMode == nullptr || Registry == nullptr) {
+		return false;
+	}
+	if (!IsGridIdle() || !Board.IsSettled())
+	{
+		UE_LOG(LogMMGame, Warning, TEXT("MMPlayGrid::ResolveMoveInstant - Grid must be idle to resolve a move."));
+		return false;
+	}
+	if (MaxPlayerMovesCount > 0 && PlayerMovesCount >= MaxPlayerMovesCount) {
+		return false;
+	}
+	if (!Board.IsValidCoords(FromCoords) || !Board.IsValidCoords(ToCoords) || !UMMMath::CoordsAdjacent(FromCoords, ToCoords)) {
+		return false;
+	}
+	const int32 MinMatchSize = GetMinimumMatchSize();
+	const int32 FromIndex = Board.ToIndex(FromCoords);
+	const int32 ToIndex = Board.ToIndex(ToCoords);
+	if (!Board.SwapHasMatch(FromIndex, ToIndex, MinMatchSize)) {
+		return false;
+	}
+	Result.bValidMove = true;
+	// A preview must not advance the grid's stream, or the recorded seed would no longer replay this game.
+	const FRandomStream SavedRandStream = RandStream;
+	FMMBoard ScratchBoard = Board;
+	ScratchBoard.SwapCells(FromIndex, ToIndex);
+	FMMBoardCascadeResult Cascade;
+	ScratchBoard.ResolveCascades(MinMatchSize, [this, Registry, bApplyToGrid](const int32 Index) -> int16
+	{
+		FName BlockTypeName;
+		FAddBlockContext BlockContext;
+		BlockContext.AddToCell = GetCellByNumber(Index);
+		if (bPauseNewBlocks || BlockContext.AddToCell == nullptr || !GetRandomBlockTypeNameForCell(BlockTypeName, BlockContext)) {
+			return FMMBoard::EmptyType;
+		}
+		const int16 TypeId = Registry->GetTypeId(BlockTypeName);
+		// The block enters the grid now, even if a later cascade step matches it away. A preview leaves the grid's state alone.
+		const FBlockType* BlockType = Registry->GetType(TypeId);
+		if (bApplyToGrid && BlockType) {
+			OnRandomBlockTypeAdded(*BlockType, nullptr);
+		}
+		return TypeId;
+	}, Cascade);
+	Result.Cascades = Cascade.NumSteps();
+	Result.MatchCount = Cascade.Matches.Num();
+	Result.BlocksMatched = Cascade.MatchedTypes.Num();
+	Result.BlocksAdded = Cascade.BlocksAdded;
+
+	// Awards. Matches made by the move itself are of the grid's own blocks, so the game mode scores them just as it does an animated move.
+	// Blocks in later cascades have no actors, so they are scored from their block types with the game mode's shared match math.
+	UGoodsDropper* GoodsDropper = GameMode->GetGoodsDropper();
+	FScopedGoodsDropperStream ScopedDropperStream(GoodsDropper, RandStream);
+	const int32 MoveMatchCount = Cascade.NumSteps() > 0 ? Cascade.StepMatchCounts[0] : 0;
+	UBlockMatch* MoveMatch = AcquireBlockMatch();
+	TArray<const FBlockType*> MatchedTypes;
+	TArray<FGoodsQuantity> BlockGoods;
+	int32 TypeOffset = 0;
+	for (int32 MatchIndex = 0; MatchIndex < Cascade.Matches.Num(); MatchIndex++)
+	{
+		const FMMBoardMatch& Match = Cascade.Matches[MatchIndex];
+		const int32 BonusMatchSize = Match.Length - MinMatchSize;
+		MatchedTypes.Reset();
+		MoveMatch->Reset();
+		for (int32 Offset = 0; Offset < Match.Length; Offset++)
+		{
+			MatchedTypes.Add(Registry->GetType(Cascade.MatchedTypes[TypeOffset + Offset]));
+			if (MatchIndex < MoveMatchCount)
+			{
+				// The grid's blocks have not been swapped yet.
+				int32 GridIndex = Board.ToIndex(Match.GetCoords(Offset));
+				GridIndex = GridIndex == FromIndex ? ToIndex : (GridIndex == ToIndex ? FromIndex : GridIndex);
+				AMMPlayGridCell* Cell = GetCellByNumber(GridIndex);
+				if (Cell && IsValid(Cell->CurrentBlock)) {
+					MoveMatch->Blocks.Add(Cell->CurrentBlock);
+				}
+			}
+		}
+		TypeOffset += Match.Length;
+		if (MoveMatch->Blocks.Num() == Match.Length)
+		{
+			MoveMatch->Orientation = Match.Orientation;
+			MoveMatch->StartCoords = Match.StartCoords;
+			MoveMatch->EndCoords = Match.GetCoords(Match.Length - 1);
+			FGoodsQuantitySet MatchGoods;
+			GameMode->GetGoodsForMatch(MoveMatch, MatchGoods);
+			Result.Score += GameMode->GetScoreForMatch(MoveMatch);
+			Result.Goods = UGoodsFunctionLibrary::AddGoodsQuantities(Result.Goods, MatchGoods.Goods);
+			continue;
+		}
+		BlockGoods.Reset();
+		if (IsValid(GoodsDropper))
+		{
+			for (const FBlockType* BlockType : MatchedTypes)
+			{
+				if (BlockType) {
+					BlockGoods.Append(AMMBlock::ScaleMatchGoods(GoodsDropper->EvaluateGoodsDropSet(BlockType->MatchDropGoods), *BlockType, BonusMatchSize));
+				}
+			}
+		}
+		Result.Score += AMMGameMode::GetScoreForMatchedTypes(MatchedTypes, BonusMatchSize);
+		Result.Goods = UGoodsFunctionLibrary::AddGoodsQuantities(Result.Goods, AMMGameMode::GetGoodsForMatchedTypes(MatchedTypes, BlockGoods));
+	}
+	ReleaseBlockMatch(MoveMatch);
+	Result.FinalBlockTypes.SetNum(ScratchBoard.Num());
+	for (int32 Index = 0; Index < ScratchBoard.Num(); Index++) {
+		Result.FinalBlockTypes[Index] = ScratchBoard.IsEmpty(Index) ? NAME_None : Registry->GetTypeName(ScratchBoard.GetType(Index));
+	}
+	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::ResolveMoveInstant - Move %s to %s resolved %d matches in %d cascades. Score %d"), *FromCoords.ToString(), *ToCoords.ToString(), Result.MatchCount, Result.Cascades, Result.Score);
+	if (bApplyToGrid)
+	{
+		ApplyBoardToGrid(ScratchBoard);
+		AddScore(Result.Score);
+		if (Result.Goods.Num() > 0) {
+			GoodsInventory->AddSubtractGoodsArray(Result.Goods, false);
+		}
+		IncrementPlayerMoveTurn();
+		FMMRecordedMove& RecordedMove = Recording.Moves.AddDefaulted_GetRef();
+		RecordedMove.FromCoords = FromCoords;
+		RecordedMove.ToCoords = ToCoords;
+		RecordedMove.bInstant = true;
+		GridLockedState = EMMGridLockState::Unchecked;
+		WakeGrid();
+	}
+	else {
+		RandStream = SavedRandStream;
+	}
+	return true;
+}
+
+
+void AMMPlayGrid::ApplyBoardToGrid(const FMMBoard& NewBoard)
+{
+	check(NewBoard.Num() == Board.Num());
+	const FBlockTypeRegistry* Registry = Board.GetBlockTypeRegistry();
+	if (Registry == nullptr) {
+		return;
+	}
+	// Release all changed blocks first so the pool can supply the new ones.
+	TArray<int32> ChangedCells;
+	for (int32 Index = 0; Index < Board.Num(); Index++)
+	{
+		if (Board.GetType(Index) != NewBoard.GetType(Index))
+		{
+			ChangedCells.Add(Index);
+			AMMPlayGridCell* Cell = GetCellByNumber(Index);
+			if (Cell && IsValid(Cell->CurrentBlock)) {
+				ReleaseBlock(Cell->CurrentBlock);
+			}
+		}
+	}
+	for (const int32 Index : ChangedCells)
+	{
+		if (NewBoard.IsEmpty(Index)) {
+			continue;
+		}
+		// New blocks were already accounted for with OnRandomBlockTypeAdded when the board was resolved, so add them by type.
+		FAddBlockContext BlockContext;
+		BlockContext.AddToCell = GetCellByNumber(Index);
+		BlockContext.bAlreadySettled = true;
+		AddBlockInCell(Registry->GetTypeName(NewBoard.GetType(Index)), BlockContext);
+	}
+	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::ApplyBoardToGrid - Replaced blocks in %d cells"), ChangedCells.Num());
+}
+
+
 bool AMMPlayGrid::BlockMoveHasMatch(const AMMBlock* CheckBlock, const EMMDirection DirectionToCheck)
 {
 	if (CheckBlock == nullptr) {
@@ -1219,49 +2074,14 @@ bool AMMPlayGrid::BlockMoveHasMatch(const AMMBlock* CheckBlock, const EMMDirecti
 		UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("   BlockMoveHasMatch coords %s and %s not adjacent. Returning False."), *FromCell->GetCoords().ToString(), *ToCell->GetCoords().ToString());
 		return false;
 	}
-	// Get non-const block ref so we can temporarily move it.
-	AMMBlock* MoveBlock = CheckBlock->OwningGridCell->CurrentBlock;
-	// Swap the blocks for now
-	ToCell->CurrentBlock = MoveBlock;
-	MoveBlock->OwningGridCell = ToCell;
-	FromCell->CurrentBlock = nullptr;
-	if (SwappingBlock)
-	{
-		FromCell->CurrentBlock = SwappingBlock;
-		SwappingBlock->OwningGridCell = FromCell;
-	}
+	// Evaluate the swap on an overlay of the board so no cells or blocks are changed.
+	const int32 FromIndex = Board.ToIndex(FromCell->GetCoords());
+	const int32 ToIndex = Board.ToIndex(ToCell->GetCoords());
+	FMMBoardOverlay Overlay(Board);
+	Overlay.SwapCells(FromIndex, ToIndex);
 	// Check for matches on moved block
-	int32 MinMatchSize = GetMinimumMatchSize();
-	UBlockMatch* TmpBlockMatch = nullptr;
-	if (MatchHorizontal(MoveBlock, &TmpBlockMatch, false) >= MinMatchSize) {
-		bFoundMatch = true;
-	}
-	else {
-		TmpBlockMatch = nullptr;
-	}
-	if (!bFoundMatch && MatchVertical(MoveBlock, &TmpBlockMatch, false) >= MinMatchSize)	{
-		bFoundMatch = true;
-	}
-	else {
-		TmpBlockMatch = nullptr;
-	}
-	// Swap the blocks back to original spots after checking
-	FromCell->CurrentBlock = MoveBlock;
-	MoveBlock->OwningGridCell = FromCell;
-	ToCell->CurrentBlock = nullptr;
-	if (SwappingBlock)
-	{
-		ToCell->CurrentBlock = SwappingBlock;
-		SwappingBlock->OwningGridCell = ToCell;
-	}
-	if (bFoundMatch){
-		if (TmpBlockMatch) {
-			UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("    BlockMoveHasMatch found match of %d blocks"), TmpBlockMatch->Blocks.Num());
-		}
-		else {
-			UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("    BlockMoveHasMatch found match: block at %s matches block at %s"), *FromCell->GetCoords().ToString(), *ToCell->GetCoords().ToString());
-		}
-	}
+	bFoundMatch = Overlay.CellHasMatch(ToIndex, GetMinimumMatchSize());
+	UE_CLOG(bDebugLog && bDebugLogMatches && bFoundMatch, LogMMGame, Log, TEXT("    BlockMoveHasMatch found match: block at %s matches block at %s"), *FromCell->GetCoords().ToString(), *ToCell->GetCoords().ToString());
 	return bFoundMatch;
 }
 
@@ -1291,19 +2111,9 @@ bool AMMPlayGrid::BlockHasMatchingMove(const AMMBlock* CheckBlock, AMMPlayGridCe
 bool AMMPlayGrid::CheckFlaggedForMatches()
 {
 	GridState = EMMGridState::Matching;
+	WakeGrid();
 	TArray<UBlockMatch*> CurrentMatches;
-	for (AMMBlock* Block : BlocksToCheck)
-	{
-		UBlockMatch* BlockMatchHoriz = nullptr;
-		UBlockMatch* BlockMatchVert = nullptr;
-		CheckForMatches(Block, &BlockMatchHoriz, &BlockMatchVert);
-		if (BlockMatchHoriz && BlockMatchHoriz->Blocks.Num() > 0) {
-			CurrentMatches.Add(BlockMatchHoriz);
-		}
-		if (BlockMatchVert && BlockMatchVert->Blocks.Num() > 0) {
-			CurrentMatches.Add(BlockMatchVert);
-		}
-	}
+	FindMatchesForBlocks(BlocksToCheck.Blocks, CurrentMatches);
 	BlocksToCheck.Empty();
 	if (CurrentMatches.Num() > 0) 
 	{
@@ -1322,201 +2132,103 @@ bool AMMPlayGrid::CheckFlaggedForMatches()
 }
 
 
-bool AMMPlayGrid::CheckForMatches(AMMBlock* CheckBlock, UBlockMatch** HorizMatchPtr, UBlockMatch** VertMatchPtr, const bool bMarkBlocks)
+int32 AMMPlayGrid::FindMatchesForBlocks(const TArray<AMMBlock*>& CheckBlocks, TArray<UBlockMatch*>& OutMatches)
 {
-	if (CheckBlock == nullptr) {
-		return false;
+	TBitArray<> CellsToCheck(false, Board.Num());
+	bool bAnyCells = false;
+	for (const AMMBlock* Block : CheckBlocks)
+	{
+		if (!IsValid(Block) || Block->OwningGridCell == nullptr || Block->OwningGridCell->CurrentBlock != Block) {
+			continue;
+		}
+		const FIntPoint Coords = Block->OwningGridCell->GetCoords();
+		if (Board.IsValidCoords(Coords))
+		{
+			CellsToCheck[Board.ToIndex(Coords)] = true;
+			bAnyCells = true;
+		}
 	}
-	UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("MMPlayGrid::CheckForMatches - Checking block %s at %s"), *CheckBlock->GetName(), *CheckBlock->GetCoords().ToString());
-	if (!CheckBlock->bMatchedHorizontal) {
-		MatchHorizontal(CheckBlock, HorizMatchPtr, bMarkBlocks);
+	if (!bAnyCells) {
+		return 0;
 	}
-	if (!CheckBlock->bMatchedVertical) {
-		MatchVertical(CheckBlock, VertMatchPtr, bMarkBlocks);
+	TArray<FMMBoardMatch> FoundMatches;
+	Board.FindMatches(GetMinimumMatchSize(), FoundMatches, &CellsToCheck);
+	const int32 StartNum = OutMatches.Num();
+	for (const FMMBoardMatch& FoundMatch : FoundMatches)
+	{
+		UBlockMatch* Match = CreateBlockMatch(FoundMatch);
+		if (Match) {
+			OutMatches.Add(Match);
+		}
 	}
-	return (HorizMatchPtr && (*HorizMatchPtr != nullptr) && (*HorizMatchPtr)->Blocks.Num() > 0) || (VertMatchPtr && (*VertMatchPtr != nullptr) && (*VertMatchPtr)->Blocks.Num() > 0);
+	UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("MMPlayGrid::FindMatchesForBlocks - Checked %d blocks, found %d matches"), CheckBlocks.Num(), OutMatches.Num() - StartNum);
+	return OutMatches.Num() - StartNum;
 }
 
 
-int32 AMMPlayGrid::MatchHorizontal(UPARAM(ref) AMMBlock* StartBlock, UBlockMatch** MatchPtr, const bool bMarkBlocks)
+UBlockMatch* AMMPlayGrid::CreateBlockMatch(const FMMBoardMatch& BoardMatch)
 {
-	MatchDirection(StartBlock, EMMDirection::West, MatchPtr, true);
-	MatchDirection(StartBlock, EMMDirection::East, MatchPtr, true);
-	if (MatchPtr && *MatchPtr != nullptr)
+	UBlockMatch* Match = AcquireBlockMatch();
+	Match->Orientation = BoardMatch.Orientation;
+	Match->Blocks.Reserve(BoardMatch.Length);
+	for (int32 i = 0; i < BoardMatch.Length; i++)
 	{
-		if ((*MatchPtr)->Blocks.Num() >= GetMinimumMatchSize())
+		AMMPlayGridCell* Cell = GetCell(BoardMatch.GetCoords(i));
+		AMMBlock* Block = Cell ? Cell->CurrentBlock : nullptr;
+		if (!IsValid(Block)) 
 		{
-			(*MatchPtr)->Orientation = EMMOrientation::Horizontal;
-			if (bMarkBlocks) 
-			{
-				for (AMMBlock* CurBlock : (*MatchPtr)->Blocks) {
-					CurBlock->bMatchedHorizontal = true;
-				}
-				(*MatchPtr)->Sort();
-			}
-			UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("    MMPlayGrid::MatchHorizontal - Found full match for block %s at %s match has %d blocks"), *StartBlock->GetName(), *StartBlock->GetCoords().ToString(), (*MatchPtr)->Blocks.Num());
+			UE_LOG(LogMMGame, Error, TEXT("MMPlayGrid::CreateBlockMatch - Board match at %s has no block at %s"), *BoardMatch.StartCoords.ToString(), *BoardMatch.GetCoords(i).ToString());
+			continue;
+		}
+		if (BoardMatch.Orientation == EMMOrientation::Horizontal) {
+			Block->bMatchedHorizontal = true;
 		}
 		else {
-			(*MatchPtr)->Reset();
+			Block->bMatchedVertical = true;
 		}
-		return (*MatchPtr)->Blocks.Num();
+		SyncBoardBlock(Block);
+		Match->Blocks.Add(Block);
+	}
+	if (Match->Blocks.Num() == 0) 
+	{
+		ReleaseBlockMatch(Match);
+		return nullptr;
 	}
-	return 0;
+	Match->Sort();
+	UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("    MMPlayGrid::CreateBlockMatch - Found %s match at %s with %d blocks"), BoardMatch.Orientation == EMMOrientation::Horizontal ? TEXT("horizontal") : TEXT("vertical"), *Match->StartCoords.ToString(), Match->Blocks.Num());
+	return Match;
 }
 
 
-int32 AMMPlayGrid::MatchVertical(UPARAM(ref) AMMBlock* StartBlock, UBlockMatch** MatchPtr, const bool bMarkBlocks)
+UBlockMatch* AMMPlayGrid::AcquireBlockMatch()
 {
-	MatchDirection(StartBlock, EMMDirection::South, MatchPtr, true);
-	MatchDirection(StartBlock, EMMDirection::North, MatchPtr, true);
-	if (MatchPtr && *MatchPtr != nullptr)
-	{
-		if ((*MatchPtr)->Blocks.Num() >= GetMinimumMatchSize())
-		{
-			(*MatchPtr)->Orientation = EMMOrientation::Vertical;
-			if (bMarkBlocks) 
-			{
-				for (AMMBlock* CurBlock : (*MatchPtr)->Blocks) {
-					CurBlock->bMatchedVertical = true;
-				}
-				(*MatchPtr)->Sort();
-			}
-			UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("    MMPlayGrid::MatchVertical - Found full match for block %s at %s match has %d blocks"), *StartBlock->GetName(), *StartBlock->GetCoords().ToString(), (*MatchPtr)->Blocks.Num());
-		}
-		else {
-			(*MatchPtr)->Reset();
-		}
-		return (*MatchPtr)->Blocks.Num();
+	if (BlockMatchPool.Num() > 0) {
+		return BlockMatchPool.Pop(false);
 	}
-	return 0;
+	return NewObject<UBlockMatch>(this);
 }
 
 
-int32 AMMPlayGrid::MatchDirection(AMMBlock* StartBlock, const EMMDirection Direction, UBlockMatch** MatchPtr, const bool bRecurse)
+void AMMPlayGrid::ReleaseBlockMatch(UBlockMatch* Match)
 {
-	if (StartBlock == nullptr) { return false; }
-	if (StartBlock->Cell())
-	{
-		if (StartBlock->OwningGridCell && StartBlock->OwningGridCell->CurrentBlock != StartBlock) {
-			UE_LOG(LogMMGame, Error, TEXT("    MMPlayGrid::MatchDirection - Cell at start coords: %s has different block %s than start block %s"), *(StartBlock->Cell()->GetCoords()).ToString(), *StartBlock->Cell()->CurrentBlock->GetName(), *StartBlock->GetName());
-		}
-		if (StartBlock->OwningGridCell == nullptr) {
-			UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Warning, TEXT("    MMPlayGrid::MatchDirection - Attempting match with block %s at %s that does not own it's cell"), *StartBlock->GetName(), *StartBlock->GetCoords().ToString());
-		}
-		FIntPoint NeighborCoords = StartBlock->GetCoords() + UMMMath::DirectionToOffset(Direction);
-		AMMPlayGridCell* NeighborCell = GetCell(NeighborCoords);
-		if (NeighborCell) {
-			UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("    MMPlayGrid::MatchDirection - Matching starting block %s at %s with cell at %s"), *StartBlock->GetName(), *StartBlock->GetCoords().ToString(), *NeighborCoords.ToString());
-		}
-		if (NeighborCell && IsValid(NeighborCell->CurrentBlock))
-		{
-			if ((UMMMath::DirectionIsHorizontal(Direction) && NeighborCell->CurrentBlock->bMatchedHorizontal) ||
-				(UMMMath::DirectionIsVertical(Direction) && NeighborCell->CurrentBlock->bMatchedVertical))
-			{
-				if (MatchPtr != nullptr && *MatchPtr != nullptr) {
-					return (*MatchPtr)->Blocks.Num();
-				}
-				else {
-					return 0;
-				}
-			}
-			bool bAlreadyMatched = false;
-			// Handle bMatchNextToPreviousInMatchGroup. If we already have some matched blocks, compare our neighbor to the previous 
-			// non-bMatchNextToPreviousInMatchGroup block found in the match instead of thls start block.
-			if (StartBlock->GetBlockType().bMatchNextToPreviousInMatchGroup && (*MatchPtr != nullptr) && (*MatchPtr)->Blocks.Num() > 1)
-			{
-				// find the last non-any block in match
-				AMMBlock* LastMatchingBlock = nullptr;
-				for (int32 i = (*MatchPtr)->Blocks.Num() - 1; i >= 0; i--)
-				{
-					LastMatchingBlock = (*MatchPtr)->Blocks[i];
-					if (!LastMatchingBlock->GetBlockType().bMatchNextToPreviousInMatchGroup) {
-						break;
-					}
-					LastMatchingBlock = nullptr;
-				}
-				if (LastMatchingBlock != nullptr)
-				{
-					// Check those blocks for match, because if they don't match then reset the match
-					if (LastMatchingBlock->Matches(NeighborCell->CurrentBlock))	{
-						bAlreadyMatched = true;						
-					}
-					else 
-					{
-						// They didn't match.
-						// If the match is already large enough, stop matching and return as normal
-						if ((*MatchPtr)->Blocks.Num() >= GetMinimumMatchSize()) {
-							UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("    MMPlayGrid::MatchDirection - Found match for block %s at %s match has %d blocks"), *StartBlock->GetName(), *StartBlock->GetCoords().ToString(), (*MatchPtr)->Blocks.Num());
-							return (*MatchPtr)->Blocks.Num();
-						}
-						// Otherwise, clear the match
-						(*MatchPtr)->Reset();
-					}					
-				}
-				// If we didn't find a last matching block, then all the current matching blocks are bMatchNextToPreviousInMatchGroup=true.
-				// So, just do the normal match below.
-			}
-			if (bAlreadyMatched || StartBlock->Matches(NeighborCell->CurrentBlock))
-			{
-				UBlockMatch* Match;
-				if (MatchPtr != nullptr && *MatchPtr != nullptr) {
-					Match = *MatchPtr;
-				}
-				else 
-				{
-					Match = NewObject<UBlockMatch>(this);
-					Match->Blocks.Empty();
-					(*MatchPtr) = Match;
-					if (UMMMath::DirectionIsHorizontal(Direction)) {
-						Match->Orientation = EMMOrientation::Horizontal;
-					}
-					else {
-						Match->Orientation = EMMOrientation::Vertical;
-					}
-				}				
-				if (Match->Blocks.Num() == 0) { Match->Blocks.Add(StartBlock); }
-				Match->Blocks.Add(NeighborCell->CurrentBlock);
-				if (bRecurse && Match->Blocks.Num() <= 40) {
-					MatchDirection(NeighborCell->CurrentBlock, Direction, &Match, bRecurse);
-				}
-			}
-		}
-	}
-	if (MatchPtr != nullptr && *MatchPtr != nullptr) {
-		UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("    MMPlayGrid::MatchDirection - Found match for block %s at %s match has %d blocks"), *StartBlock->GetName(), *StartBlock->GetCoords().ToString(), (*MatchPtr)->Blocks.Num());
-		return (*MatchPtr)->Blocks.Num();
-	}
-	else {
-		return 0;
+	if (!IsValid(Match)) {
+		return;
 	}
+	Match->Reset();
+	Match->bMatchFinished = false;
+	BlockMatchPool.Add(Match);
 }
 
 
 void AMMPlayGrid::SortMatches(/*const bool bForceSort*/ )
 {
-	int32 Index;
-	TArray<UBlockMatch*> TmpMatches;
-	TmpMatches.Reserve(BlockMatches.Num());
 	for (UBlockMatch* Match : BlockMatches)	{
 		Match->Sort();
 	}
-	for (UBlockMatch* Match : BlockMatches)
-	{
-		Index = 0;
-		for (UBlockMatch* CompareMatch : TmpMatches)
-		{
-			if (CompareMatch == nullptr) { 
-				break; 
-			}
-			if (Match->StartCoords.Y < CompareMatch->StartCoords.Y || (Match->StartCoords.Y == CompareMatch->StartCoords.Y && Match->StartCoords.X < CompareMatch->StartCoords.X)) {
-				break;
-			}
-			Index++;
-		}
-		TmpMatches.Insert(Match, Index);
-	}
-	BlockMatches.Empty(TmpMatches.Num());
-	BlockMatches.Append(TmpMatches);
+	// Sort from bottom row to top row, then left to right. Stable, so matches starting at the same coords keep their order.
+	BlockMatches.StableSort([](const UBlockMatch& A, const UBlockMatch& B) {
+		return A.StartCoords.Y < B.StartCoords.Y || (A.StartCoords.Y == B.StartCoords.Y && A.StartCoords.X < B.StartCoords.X);
+	});
 	UE_CLOG(bDebugLog && bDebugLogMatches, LogMMGame, Log, TEXT("MMPlayGrid::SortMatches - Sorted %d matches"), BlockMatches.Num());
 }
 
@@ -1535,7 +2247,10 @@ bool AMMPlayGrid::ResolveMatches()
 	{
 		UBlockMatch* CurMatch = BlockMatches[MatchIndex];
 		FGoodsQuantitySet MatchGoods;
-		GameMode->GetGoodsForMatch(CurMatch, MatchGoods);
+		{
+			FScopedGoodsDropperStream ScopedDropperStream(GameMode->GetGoodsDropper(), RandStream);
+			GameMode->GetGoodsForMatch(CurMatch, MatchGoods);
+		}
 		if (MatchGoods.Goods.Num() > 0) 
 		{
 			CurMatch->TotalGoods = MatchGoods.Goods;
@@ -1698,56 +2413,163 @@ EMMGridLockState AMMPlayGrid::CheckGridIsLocked()
 	if (GridLockedState == EMMGridLockState::Locked || GridLockedState == EMMGridLockState::NotLocked) {
 		return GridLockedState;
 	}
-	if (GridLockedState == EMMGridLockState::Unchecked) 
+	// The board only re-evaluates moves around cells that changed since the last check.
+	const int32 ValidMoveCount = Board.UpdateMoveIndex(GetMinimumMatchSize());
+	GridLockedState = ValidMoveCount > 0 ? EMMGridLockState::NotLocked : EMMGridLockState::Locked;
+	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("CheckGridIsLocked %s. %d valid moves."), GridLockedState == EMMGridLockState::Locked ? TEXT("### Locked") : TEXT("Not Locked"), ValidMoveCount);
+	return GridLockedState;
+}
+
+
+void AMMPlayGrid::UpdateGridLockedState()
+{
+	if (GridLockedState == EMMGridLockState::Unchecked || GridLockedState == EMMGridLockState::Checking)
+	{
+		if (CheckGridIsLocked() == EMMGridLockState::Locked)
+		{
+			if (bReshuffleOnLock && ReshuffleBlocks()) {
+				UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::UpdateGridLockedState - Grid was locked. Reshuffled blocks."));
+			}
+			else {
+				// Call delegate if grid is locked
+				OnGridLocked.Broadcast(this);
+			}
+		}
+	}
+}
+
+
+bool AMMPlayGrid::ReshuffleBlocks()
+{
+	if (GridState != EMMGridState::Normal) 
 	{
-		GridLockCheckCoords = FIntPoint::ZeroValue;
-		GridLockedState = EMMGridLockState::Checking;
+		UE_LOG(LogMMGame, Warning, TEXT("MMPlayGrid::ReshuffleBlocks - Grid can only be reshuffled in normal state."));
+		return false;
 	}
-	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("CheckGridIsLocked checking"));
-	for (int32 i = 0; i < GridLockChecksPerTick; i++)
+	const int32 MinMatchSize = GetMinimumMatchSize();
+	// Only cells with settled, mobile blocks take part in the shuffle.
+	TArray<int32> ShuffleCells;
+	TArray<int16> ShuffleTypes;
+	for (int32 Index = 0; Index < Board.Num(); Index++)
 	{
-		// Check current GridLockCheckCoords
-		AMMBlock* CurBlock = GetBlock(GridLockCheckCoords);
-		if (CurBlock && BlockHasMatchingMove(CurBlock)) 
+		if (Board.IsMobile(Index) && Board.IsMatchable(Index) && !Board.HasFlags(Index, EMMBoardCellFlags::MatchedHorizontal | EMMBoardCellFlags::MatchedVertical))
+		{
+			ShuffleCells.Add(Index);
+			ShuffleTypes.Add(Board.GetType(Index));
+		}
+	}
+	if (ShuffleCells.Num() < 2) {
+		return false;
+	}
+	// Deal the types out to the cells on a copy of the board, bottom left to top right, never placing a type that would make a match.
+	// Then check the result has a valid move. Try again with a different deal if either fails.
+	const int32 MaxAttempts = 20;
+	FMMBoard ScratchBoard = Board;
+	TArray<int16> NewTypes;
+	NewTypes.Init(FMMBoard::EmptyType, ShuffleCells.Num());
+	TArray<int16> RemainingTypes;
+	TBitArray<> MatchingTypeIds;
+	bool bFoundShuffle = false;
+	for (int32 Attempt = 0; Attempt < MaxAttempts && !bFoundShuffle; Attempt++)
+	{
+		for (const int32 Index : ShuffleCells) {
+			ScratchBoard.ClearCell(Index);
+		}
+		RemainingTypes = ShuffleTypes;
+		bool bDealtAll = true;
+		for (int32 i = 0; i < ShuffleCells.Num(); i++)
 		{
-			GridLockedState = EMMGridLockState::NotLocked;
-			UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("CheckGridIsLocked Grid is Not Locked"), GridLockedState == EMMGridLockState::Locked ? TEXT("Locked") : TEXT("Not Locked"));
-			return GridLockedState;
-		}
-		// Determine next cell to check
-		if (GridLockCheckCoords.X == SizeX - 1) {
-			// At the end of a row. Check next row up.
-			if (GridLockCheckCoords.Y == SizeY - 1)
+			ScratchBoard.GetTypesCompletingRun(ShuffleCells[i], MinMatchSize, MatchingTypeIds);
+			// Start at a random remaining type and take the first one that doesn't match.
+			const int32 StartIndex = RandStream.RandRange(0, RemainingTypes.Num() - 1);
+			int32 PickedIndex = INDEX_NONE;
+			for (int32 n = 0; n < RemainingTypes.Num(); n++)
 			{
-				// At the top row then there was no match move, so grid is locked.
-				GridLockedState = EMMGridLockState::Locked;
-				UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("CheckGridIsLocked ### Grid is Locked"));
-				return GridLockedState;
+				const int32 TypeIndex = (StartIndex + n) % RemainingTypes.Num();
+				if (!MatchingTypeIds.IsValidIndex(RemainingTypes[TypeIndex]) || !MatchingTypeIds[RemainingTypes[TypeIndex]])
+				{
+					PickedIndex = TypeIndex;
+					break;
+				}
 			}
-			else
+			if (PickedIndex == INDEX_NONE) 
 			{
-				// Move to next row
-				GridLockCheckCoords.X = 0;
-				GridLockCheckCoords.Y++;
+				bDealtAll = false;
+				break;
 			}
+			NewTypes[i] = RemainingTypes[PickedIndex];
+			ScratchBoard.SetCell(ShuffleCells[i], NewTypes[i], EMMBoardCellFlags::None);
+			RemainingTypes.RemoveAtSwap(PickedIndex, 1, false);
+		}
+		bFoundShuffle = bDealtAll && ScratchBoard.UpdateMoveIndex(MinMatchSize) > 0;
+	}
+	if (!bFoundShuffle) 
+	{
+		UE_LOG(LogMMGame, Warning, TEXT("MMPlayGrid::ReshuffleBlocks - Could not find a shuffle with no matches and a valid move after %d attempts."), MaxAttempts);
+		return false;
+	}
+	// Assign a block of the right type to each cell. Blocks that already have the right type stay in their cell.
+	TArray<AMMBlock*> NewBlocks;
+	NewBlocks.Init(nullptr, ShuffleCells.Num());
+	TMap<int16, TArray<AMMBlock*>> FreeBlocksByType;
+	for (int32 i = 0; i < ShuffleCells.Num(); i++)
+	{
+		AMMBlock* Block = GetCellByNumber(ShuffleCells[i])->CurrentBlock;
+		check(Block);
+		if (Block->GetBlockTypeId() == NewTypes[i]) {
+			NewBlocks[i] = Block;
 		}
 		else {
-			// Move to next cell in row
-			GridLockCheckCoords.X++;
+			FreeBlocksByType.FindOrAdd(Block->GetBlockTypeId()).Add(Block);
 		}
 	}
-	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("CheckGridIsLocked %s"), GridLockedState == EMMGridLockState::Locked ? TEXT("### Locked") : TEXT("Not Locked"));
-	return GridLockedState;
+	for (int32 i = 0; i < ShuffleCells.Num(); i++)
+	{
+		if (NewBlocks[i] == nullptr) 
+		{
+			TArray<AMMBlock*>* FreeBlocks = FreeBlocksByType.Find(NewTypes[i]);
+			check(FreeBlocks && FreeBlocks->Num() > 0);
+			NewBlocks[i] = FreeBlocks->Pop(false);
+		}
+	}
+	// Clear the cells of moving blocks first so no block is put in a cell that another block still owns.
+	for (int32 i = 0; i < ShuffleCells.Num(); i++)
+	{
+		AMMPlayGridCell* Cell = GetCellByNumber(ShuffleCells[i]);
+		if (Cell->CurrentBlock != NewBlocks[i]) {
+			Cell->SetCurrentBlock(nullptr);
+		}
+	}
+	int32 MovedCount = 0;
+	for (int32 i = 0; i < ShuffleCells.Num(); i++)
+	{
+		AMMPlayGridCell* Cell = GetCellByNumber(ShuffleCells[i]);
+		AMMBlock* Block = NewBlocks[i];
+		if (Cell->CurrentBlock == Block) {
+			continue;
+		}
+		Cell->SetCurrentBlock(Block);
+		Block->OwningGridCell = Cell;
+		UnsettledBlocks.Add(Block);
+		Block->OnMove(Cell);
+		MovedCount++;
+	}
+	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::ReshuffleBlocks - Moving %d of %d mobile blocks"), MovedCount, ShuffleCells.Num());
+	GridLockedState = EMMGridLockState::Unchecked;
+	GridState = EMMGridState::Moving;
+	WakeGrid();
+	return true;
 }
 
 
-
 void AMMPlayGrid::SettleBlocks()
 {
 	GridState = EMMGridState::Settling;
+	WakeGrid();
 	DebugBlocks(FString("SettleBlocksStart"));
-	// Unsettle all blocks that were queued for unsettling
-	for (AMMBlock* CurBlock : UnsettledBlocks)
+	// Unsettle all blocks that were queued for unsettling. Iterate a copy since blocks that don't need to move leave UnsettledBlocks immediately.
+	const TArray<AMMBlock*> BlocksToUnsettle = UnsettledBlocks.Blocks;
+	for (AMMBlock* CurBlock : BlocksToUnsettle)
 	{
 		if (!CurBlock->bUnsettled) {
 			CurBlock->OnUnsettle();
@@ -1766,50 +2588,13 @@ void AMMPlayGrid::UnsettleBlock(AMMBlock* Block)
 	// If it is a movable unmatched block, unsettle it.
 	if (Block->CanMove() && !Block->IsMatched() && !Block->bUnsettled) 
 	{
-		UnsettledBlocks.AddUnique(Block);
+		UnsettledBlocks.Add(Block);
 		if (GridState == EMMGridState::Settling) {
 			Block->OnUnsettle();
 		}
 	}
 }
 
-void AMMPlayGrid::UnsettleBlockAboveCell(AMMPlayGridCell* Cell)
-{
-	if (Cell == nullptr) {
-		UE_LOG(LogMMGame, Error, TEXT("MMPlayGrid::UnsettleBlockAboveCell - Called with nullptr cell"));
-		return;
-	}
-	// Get the cell and block above it
-	AMMPlayGridCell* AboveCell = GetCell(Cell->GetCoords() + UMMMath::DirectionToOffset(EMMDirection::North));
-	AMMBlock* AboveBlock = nullptr;
-	if (AboveCell) 
-	{
-		if (IsValid(AboveCell->CurrentBlock) && !AboveCell->CurrentBlock->IsMatched()) {
-			ToBeUnsettledBlocks.AddUnique(AboveCell->CurrentBlock);
-		}
-	}
-	else 
-	{
-		// At top of column, so unsettle lowest block falling into grid that is not already unsettled
-		int32 Col = Cell->GetCoords().X;
-		AMMBlock* FirstBlock = nullptr;
-		for (int32 i = 0; i < BlocksFallingIntoGrid[Col].Blocks.Num(); i++)
-		{
-			AMMBlock* FallingBlock = BlocksFallingIntoGrid[Col].Blocks[i];
-			if (ToBeUnsettledBlocks.Contains(FallingBlock) || UnsettledBlocks.Contains(FallingBlock)) {
-				continue;
-			}
-			if (FirstBlock == nullptr || FallingBlock->GetRelativeLocation().Z < FirstBlock->GetRelativeLocation().Z) {
-				FirstBlock = FallingBlock;
-			}
-		}
-		if (FirstBlock) {
-			ToBeUnsettledBlocks.AddUnique(FirstBlock);
-		}
-	}
-}
-
-
 void AMMPlayGrid::AddScore(int32 PointsToAdd)
 {
 	// Increment score
@@ -1825,13 +2610,17 @@ void AMMPlayGrid::BlockFinishedMoving(AMMBlock* Block, bool bBlockMoved)
 	if (bBlockMoved)
 	{
 		if (IsValid(Block)) {
-			BlocksToCheck.AddUnique(Block);
+			BlocksToCheck.Add(Block);
 		}
 		if (Block->StopMoveSound) {
 			PlaySoundQueue.AddUnique(Block->StopMoveSound.Get());
 		}
 	}
-	if (Block != nullptr) { UnsettledBlocks.RemoveSingle(Block); }
+	if (Block != nullptr) 
+	{ 
+		UnsettledBlocks.Remove(Block);
+		SyncBoardBlock(Block);
+	}
 }
 
 
@@ -1843,7 +2632,7 @@ void AMMPlayGrid::BlockFinishedMatch(AMMBlock* Block, UBlockMatch* Match)
 	if (Block->OwningGridCell && Block->OwningGridCell->CurrentBlock == Block) 
 	{
 		// Clear the owning grid cell. The cell is now open for other blocks. But don't tell grid yet.
-		Block->OwningGridCell->CurrentBlock = nullptr;
+		Block->OwningGridCell->SetCurrentBlock(nullptr);
 		//CellBecameOpen(Block->OwningGridCell);
 	}
 	for (AMMBlock* CurBlock : Match->Blocks)
@@ -1882,11 +2671,13 @@ void AMMPlayGrid::AllMatchesFinished()
 		PerformActionsForMatch(BlockMatch, true);
 	}
 	// Apply match damage to unmatched neighbors. 
+	TArray<AMMPlayGridCell*> Neighbors;
 	for (UBlockMatch* BlockMatch : BlockMatches) 
 	{
 		// Larger matches do more damage.
 		int32 MatchDamage = (BlockMatch->Blocks.Num() - GetMinimumMatchSize()) + 1;
-		TArray<AMMPlayGridCell*> Neighbors = BlockMatch->GetCellNeighbors();
+		Neighbors.Reset();
+		GetMatchNeighbors(BlockMatch, Neighbors);
 		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::AllMatchesFinished - checking match damage at %s on %d neighbors"), *BlockMatch->StartCoords.ToString(), Neighbors.Num());
 		for (AMMPlayGridCell* Neighbor : Neighbors)	{
 			// Ignore neighbors that are in a match -- they will be destroyed as part of their match.
@@ -1907,15 +2698,12 @@ void AMMPlayGrid::AllMatchesFinished()
 		for (int32 BIndex = 0; BIndex < BlockMatchSize; BIndex++)
 		{
 			AMMBlock* CurBlock = BlockMatches[i]->Blocks[BIndex];
-			if (IsValid(CurBlock))
+			// Blocks in two matches are released with the first one.
+			if (IsValid(CurBlock) && !CurBlock->IsPooled())
 			{
 				AMMPlayGridCell* BlockCell = CurBlock->Cell();
 				UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("MMPlayGrid::AllMatchesFinished - DESTROYING block %s at %s"), *CurBlock->GetName(), *CurBlock->GetCoords().ToString());
-				Blocks.RemoveSingle(CurBlock);
-				//UnsettledBlocks.RemoveSingle(CurBlock);
-				//ToBeUnsettledBlocks.RemoveSingle(CurBlock);
-				//BlocksToCheck.RemoveSingle(CurBlock);
-				CurBlock->DestroyBlock();	
+				ReleaseBlock(CurBlock);
 				check(BlockCell);
 				if (!IsValid(BlockCell->CurrentBlock)) {
 					DropInCells.AddUnique(BlockCell);
@@ -1925,7 +2713,7 @@ void AMMPlayGrid::AllMatchesFinished()
 				}
 			}
 		}
-		BlockMatches[i]->Blocks.Empty();
+		BlockMatches[i]->Blocks.Reset();
 	}
 	// Destroy blocks queueud for destruction
 	FGoodsQuantitySet TmpGoodsSet;
@@ -1933,11 +2721,12 @@ void AMMPlayGrid::AllMatchesFinished()
 	AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
 	for (AMMBlock* Block : BlocksToDestroy)
 	{
-		if (IsValid(Block))
+		if (IsValid(Block) && !Block->IsPooled())
 		{
 			if (GameMode && !Block->IsMatched() && !Block->bFallingIntoGrid)
 			{
 				// Get goods from these destroyed blocks
+				FScopedGoodsDropperStream ScopedDropperStream(GameMode->GetGoodsDropper(), RandStream);
 				if (GameMode->GetGoodsForBlock(Block, TmpGoodsSet)) {
 					//DestroyedGoods.Append(TmpGoodsSet.Goods);
 					GoodsInventory->AddSubtractGoodsArray(TmpGoodsSet.Goods, false);
@@ -1947,11 +2736,7 @@ void AMMPlayGrid::AllMatchesFinished()
 			PlaySoundQueue.AddUnique(Block->DestroySound.Get());
 			Block->OnBlockDestroyed();
 			AMMPlayGridCell* BlockCell = Block->Cell();
-			Blocks.RemoveSingle(Block);
-			UnsettledBlocks.RemoveSingle(Block);
-			ToBeUnsettledBlocks.RemoveSingle(Block);
-			BlocksToCheck.RemoveSingle(Block);
-			Block->DestroyBlock();
+			ReleaseBlock(Block);
 			UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("     ##### Destroyed block at %s"), *BlockCell->GetCoords().ToString());
 			//CellBecameOpen(BlockCell);
 			DropInCells.AddUnique(BlockCell);
@@ -1978,14 +2763,18 @@ void AMMPlayGrid::AllMatchesFinished()
 			}
 		}
 	}
-	// Notify grid of each empty cell
+	// Notify grid of each empty cell, then plan the settling of each column with an empty cell.
 	for (AMMPlayGridCell* DropInCell : DropInCells)
 	{
 		if (!IsValid(DropInCell->CurrentBlock)) {
 			CellBecameOpen(DropInCell);
 		}
 	}
-	BlockMatches.Empty();	
+	PlanColumnSettles();
+	for (UBlockMatch* BlockMatch : BlockMatches) {
+		ReleaseBlockMatch(BlockMatch);
+	}
+	BlockMatches.Reset();
 }
 
 
@@ -1997,9 +2786,10 @@ void AMMPlayGrid::BlockDestroyedByDamage(AMMBlock* Block)
 	{
 		if (Block->OwningGridCell && Block->OwningGridCell->CurrentBlock == Block) {
 			// Clear the owning grid cell. The cell is now open for other blocks. But don't tell grid yet.
-			Block->OwningGridCell->CurrentBlock = nullptr;
+			Block->OwningGridCell->SetCurrentBlock(nullptr);
 		}
-		BlocksToDestroy.AddUnique(Block);
+		BlocksToDestroy.Add(Block);
+		WakeGrid();
 	}
 	else {
 		UE_CLOG(bDebugLog, LogMMGame, Warning, TEXT("MMPlayGrid::BlockDestroyedByDamage - Did not destroy block %s at %d"), *Block->GetName(), *Block->GetCoords().ToString());
@@ -2015,9 +2805,10 @@ void AMMPlayGrid::BlockDestroyedByGameEffect(AMMBlock* Block)
 	{
 		if (Block->OwningGridCell && Block->OwningGridCell->CurrentBlock == Block) {
 			// Clear the owning grid cell. The cell is now open for other blocks. But don't tell grid yet.
-			Block->OwningGridCell->CurrentBlock = nullptr;
+			Block->OwningGridCell->SetCurrentBlock(nullptr);
 		}
-		BlocksToDestroy.AddUnique(Block);
+		BlocksToDestroy.Add(Block);
+		WakeGrid();
 		
 	}
 	else {
@@ -2034,9 +2825,10 @@ void AMMPlayGrid::BlockDestroyedByMatchAction(AMMBlock* Block)
 	{
 		if (Block->OwningGridCell && Block->OwningGridCell->CurrentBlock == Block) {
 			// Clear the owning grid cell. The cell is now open for other blocks. But don't tell grid yet.
-			Block->OwningGridCell->CurrentBlock = nullptr;
+			Block->OwningGridCell->SetCurrentBlock(nullptr);
 		}
-		BlocksToDestroy.AddUnique(Block);
+		BlocksToDestroy.Add(Block);
+		WakeGrid();
 	}
 	else {
 		UE_CLOG(bDebugLog, LogMMGame, Warning, TEXT("MMPlayGrid::BlockDestroyedByMatchAction - Did not destroy block %s at %d"), *Block->GetName(), *Block->GetCoords().ToString());
@@ -2110,15 +2902,29 @@ bool AMMPlayGrid::DebugBlocks(const FString& ContextString)
 			}
 		}
 	}
+	// Check that the board model agrees with the cells
+	for (AMMPlayGridCell* Cell : Cells)
+	{
+		if (!IsValid(Cell) || !Board.IsValidCoords(Cell->GetCoords())) {
+			continue;
+		}
+		const int16 BoardTypeId = Board.GetType(Board.ToIndex(Cell->GetCoords()));
+		const int16 CellTypeId = IsValid(Cell->CurrentBlock) ? Cell->CurrentBlock->GetBlockTypeId() : FMMBoard::EmptyType;
+		if (BoardTypeId != CellTypeId) 
+		{
+			UE_LOG(LogMMGame, Error, TEXT("DebugBlocks: Board model has block type id %d at %s but cell has %d"), BoardTypeId, *Cell->GetCoords().ToString(), CellTypeId);
+			bAnyError = true;
+		}
+	}
 	TArray<AActor*> AllBlocks;
 	UGameplayStatics::GetAllActorsOfClass(GetWorld(), AMMBlock::StaticClass(), AllBlocks);
-	if (Blocks.Num() != AllBlocks.Num()) {
-		UE_CLOG(bDebugLog, LogMMGame, Warning, TEXT("DebugBlocks: %d blocks found in world"), AllBlocks.Num());
+	if (Blocks.Num() + BlockPool.Num() != AllBlocks.Num()) {
+		UE_CLOG(bDebugLog, LogMMGame, Warning, TEXT("DebugBlocks: %d blocks found in world, %d blocks in pool"), AllBlocks.Num(), BlockPool.Num());
 	}
 	for (AActor* CurActor : AllBlocks)
 	{
 		AMMBlock* CurBlock = Cast<AMMBlock>(CurActor);
-		if (CurBlock)
+		if (CurBlock && !CurBlock->IsPooled())
 		{
 			if (!Blocks.Contains(CurBlock))
 			{
@@ -61,6 +61,9 @@ void AMMPlayGridCell::OnFingerPressedCell(ETouchIndex::Type FingerIndex, UPrimit
 
 void AMMPlayGridCell::Highlight(bool bOn)
 {
+	if (OwningGrid && OwningGrid->HighlightCellInstance(this, bOn)) {
+		return;
+	}
 	if (bOn) {
 		CellMesh->SetMaterial(0, AltMaterial);
 	}
@@ -76,6 +79,15 @@ FIntPoint AMMPlayGridCell::GetCoords() const
 }
 
 
+void AMMPlayGridCell::SetCurrentBlock(AMMBlock* NewBlock)
+{
+	CurrentBlock = NewBlock;
+	if (OwningGrid) {
+		OwningGrid->SyncBoardCell(this);
+	}
+}
+
+
 FVector AMMPlayGridCell::GetBlockWorldLocation()
 {
 	if (OwningGrid) {
@@ -103,7 +115,7 @@ void AMMPlayGridCell::DestroyCell()
 	if (IsValid(CurrentBlock))
 	{
 		CurrentBlock->DestroyBlock();
-		CurrentBlock = nullptr;
+		SetCurrentBlock(nullptr);
 	}
 	Destroy();
 }
\ No newline at end of file
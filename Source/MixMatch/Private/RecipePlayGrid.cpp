@@ -21,10 +21,11 @@ ARecipePlayGrid::ARecipePlayGrid()
 }
 
 
-void  ARecipePlayGrid::StartPlayGrid_Implementation()
+void ARecipePlayGrid::SeedRandomStream()
 {
+	Super::SeedRandomStream();
+	// The drop odds draw from the grid's stream, so rebuild them from the new seed.
 	InitIngredientBlockDropOdds(true);
-	Super::StartPlayGrid_Implementation();
 }
 
 
@@ -71,6 +72,12 @@ void ARecipePlayGrid::SetRecipe(FCraftingRecipe& Recipe)
 {
 	CurrentRecipe = Recipe;
 	NonIngredientBlockTypeSetBaseName = Recipe.BlockTypeSetBase;
+	// TODO: Improve the table name determination logic.
+	// Currently we will set the BlockTypeSetName to a block type set that has no ingredient blocks and has only the number of block types 
+	// normally available to a recipe with a given number of ingredients.
+	// i.e. TargetBlockTypes - CraftingInputs.Num()
+	//FName UseBlockTypeSetName = FName(FString::Printf(TEXT("%s_%d"), *NonIngredientBlockTypeSetBaseName, FMath::Max(0, TargetBlockTypes - GetRecipe().CraftingInputs.Num())));
+	SetBlockTypeSetName(FName(NonIngredientBlockTypeSetBaseName));
 	if (GetRecipeManager()) {
 		TargetBlockTypes = GetRecipeManager()->GetTargetBlockTypeCount(CurrentRecipe);
 	}
@@ -168,24 +175,29 @@ bool ARecipePlayGrid::GetRandomBlockTypeNameForCell_Implementation(FName& FoundB
 	}
 	InitIngredientBlockDropOdds();
 	FoundBlockTypeName = NAME_None;
-	bool bUseExclusionList = BlockContext.ExcludedBlockNames.Num() > 0 && FMath::FRandRange(0.f, 1.f) < DuplicateSpawnPreventionFactor;
-	if (FMath::FRand() < GetChanceForIngredientBlock())
+	bool bUseExclusionList = BlockContext.ExcludedBlockNames.Num() > 0 && RandStream.FRandRange(0.f, 1.f) < DuplicateSpawnPreventionFactor;
+	if (RandStream.FRand() < GetChanceForIngredientBlock())
 	{
-		// Determine which ingredient goods are not excluded
+		// Determine which ingredient goods are not excluded. Forbidden ingredients are never allowed.
 		TArray<FGoodsQuantity> AllowedInputs;
+		TArray<FGoodsQuantity> UnforbiddenInputs;
 		// Iterate through the cached block drop odds for the grid's recipe
 		for (int32 i = 0; i < IngredientBlockDropOdds.Num(); i++)
 		{
+			if (BlockContext.ForbiddenBlockNames.Contains(IngredientBlockDropOdds[i].Name)) {
+				continue;
+			}
+			UnforbiddenInputs.Add(IngredientBlockDropOdds[i]);
 			if (!bUseExclusionList || !BlockContext.ExcludedBlockNames.Contains(IngredientBlockDropOdds[i].Name)) {
 				AllowedInputs.Add(IngredientBlockDropOdds[i]);
 			}
 		}
 		// Only do this if we're not using inventory goods or we have at least one that we have inventory for
-		if (!bIngredientsFromInventory || IngredientBlockDropOdds.Num() > 0)
+		if ((!bIngredientsFromInventory || IngredientBlockDropOdds.Num() > 0) && UnforbiddenInputs.Num() > 0)
 		{
 			// If we ended up with no allowed input ingredients, then pick a random one from our list of ingredients we have inventory for.
 			if (AllowedInputs.Num() == 0) {
-				AllowedInputs.Add(IngredientBlockDropOdds[FMath::RandRange(0, IngredientBlockDropOdds.Num() - 1)]);
+				AllowedInputs.Add(UnforbiddenInputs[RandStream.RandRange(0, UnforbiddenInputs.Num() - 1)]);
 			}
 
 			float TotalWeight = 0.f;
@@ -199,7 +211,7 @@ bool ARecipePlayGrid::GetRandomBlockTypeNameForCell_Implementation(FName& FoundB
 					TotalWeight += IngredientGoods.Quantity;
 				}
 				float WeightSum = 0.f;
-				float PickedWeight = FMath::RandRange(0.f, TotalWeight);
+				float PickedWeight = RandStream.FRandRange(0.f, TotalWeight);
 				for (FGoodsQuantity IngredientGoods : AllowedInputs)
 				{
 					WeightSum += IngredientGoods.Quantity;
@@ -220,50 +232,49 @@ bool ARecipePlayGrid::GetRandomBlockTypeNameForCell_Implementation(FName& FoundB
 	// If we haven't found a block name yet, do it via game mode.
 	if(FoundBlockTypeName.IsNone())
 	{
-		// TODO: Improve the table name determination logic.
-		// Currently we will set the BlockTypeSetName to a block type set that has no ingredient blocks and has only the number of block types 
-		// normally available to a recipe with a given number of ingredients.
-		// i.e. TargetBlockTypes - CraftingInputs.Num()
-		//FName UseBlockTypeSetName = FName(FString::Printf(TEXT("%s_%d"), *NonIngredientBlockTypeSetBaseName, FMath::Max(0, TargetBlockTypes - GetRecipe().CraftingInputs.Num())));
-		SetBlockTypeSetName(FName(NonIngredientBlockTypeSetBaseName));
-		if (bUseExclusionList) {
-			GameMode->GetRandomBlockTypeNameForCell(FoundBlockTypeName, BlockContext);
-		}
-		else {
-			FAddBlockContext TmpContext = BlockContext;
-			TmpContext.ExcludedBlockNames.Empty();
-			GameMode->GetRandomBlockTypeNameForCell(FoundBlockTypeName, TmpContext);
-		}
+		// The grid's BlockTypeSetName is set to the recipe's non-ingredient block type set in SetRecipe.
+		GameMode->GetRandomBlockTypeNameForCell(FoundBlockTypeName, BlockContext, bUseExclusionList);
 		UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("RecipePlayGrid::GetRandomBlockTypeNameForCell - Got block type: %s from BlockTypeSet %s"), *FoundBlockTypeName.ToString(),*GetBlockTypeSetName().ToString());
 	}
 	return !FoundBlockTypeName.IsNone();
 }
 
-/** Override the base class so we can drop "ingredient blocks" based on the grid's recipe. */
-AMMBlock* ARecipePlayGrid::AddRandomBlockInCell(const FAddBlockContext& BlockContext)
+/** Override the base class so we can deduct "ingredient blocks" based on the grid's recipe. */
+void ARecipePlayGrid::OnRandomBlockTypeAdded(const FBlockType& BlockType, AMMBlock* NewBlock)
 {
-	// Call base class first
-	AMMBlock* NewBlock = Super::AddRandomBlockInCell(BlockContext);
+	Super::OnRandomBlockTypeAdded(BlockType, NewBlock);
+	// Blocks reuse grid slots, so clear whatever was recorded for the slot's previous block.
+	if (NewBlock && NewBlock->GetGridSlot() >= 0)
+	{
+		if (DeductedIngredientGoods.Num() <= NewBlock->GetGridSlot()) {
+			DeductedIngredientGoods.SetNum(NewBlock->GetGridSlot() + 1);
+		}
+		DeductedIngredientGoods[NewBlock->GetGridSlot()].Reset();
+	}
 
-	// Check NewBLock for ingredient logic
-	if (NewBlock && bIngredientsFromInventory && NewBlock->HasCategory(BlockCategory::Goods))
+	// Check the new block's type for ingredient logic
+	if (bIngredientsFromInventory && BlockType.BlockCategories.Contains(BlockCategory::Goods))
 	{
 		AMMGameMode* GameMode = Cast<AMMGameMode>(UGameplayStatics::GetGameMode(this));
 		check(GameMode);
 		if (GameMode) 
 		{
-			FName BlockTypeName = NewBlock->GetBlockType().Name;
+			FName BlockTypeName = BlockType.Name;
 			for (FGoodsQuantity GQ : GetRecipe().CraftingInputs)
 			{
 				if (GQ.Name == BlockTypeName)
 				{
 					// If this block type's name matches a recipe ingredient name, determine what quantities of ingredient 
-					// goods the block will produce on a normal match.
-					TArray<FGoodsQuantity> BlockAwardGoods = NewBlock->GetBaseMatchGoods(GameMode->GetGoodsDropper(), 0.5f);
+					// goods the block will produce on a normal match. Blocks only on a resolved board use their type's match goods.
+					FScopedGoodsDropperStream ScopedDropperStream(GameMode->GetGoodsDropper(), RandStream);
+					TArray<FGoodsQuantity> BlockAwardGoods = NewBlock ? NewBlock->GetBaseMatchGoods(GameMode->GetGoodsDropper(), 0.5f) : GameMode->GetGoodsDropper()->EvaluateGoodsDropSet(BlockType.MatchDropGoods, 0.5f);
 					TArray<FGoodsQuantity> IngredientAwardGoods = UGoodsFunctionLibrary::CountsInGoodsQuantities(GetRecipe().CraftingInputs, BlockAwardGoods);
 					// Subtract block's ingredient match goods from grid's inventory.
 					if (!InputGoodsInventory->AddSubtractGoodsArray(IngredientAwardGoods, true)) {
-						UE_LOG(LogMMGame, Warning, TEXT("RecipePlayGrid::AddRandomBlockInCell - cannot deduct goods from grid input inventory for block %s with block type %s"), *NewBlock->GetName(), *NewBlock->GetBlockType().Name.ToString());
+						UE_LOG(LogMMGame, Warning, TEXT("RecipePlayGrid::OnRandomBlockTypeAdded - cannot deduct goods from grid input inventory for block type %s"), *BlockTypeName.ToString());
+					}
+					else if (NewBlock && NewBlock->GetGridSlot() >= 0) {
+						DeductedIngredientGoods[NewBlock->GetGridSlot()] = IngredientAwardGoods;
 					}
 					int32 Index = IngredientBlockDropOdds.IndexOfByKey(BlockTypeName);
 					if (Index != INDEX_NONE && !InputGoodsInventory->HasAllGoods(IngredientAwardGoods)) {
@@ -278,7 +289,46 @@ AMMBlock* ARecipePlayGrid::AddRandomBlockInCell(const FAddBlockContext& BlockCon
 			}
 		}
 	}
-	return NewBlock;
+}
+
+
+void ARecipePlayGrid::OnRandomBlockRemoved(AMMBlock* Block)
+{
+	Super::OnRandomBlockRemoved(Block);
+	if (Block == nullptr || !DeductedIngredientGoods.IsValidIndex(Block->GetGridSlot()) || DeductedIngredientGoods[Block->GetGridSlot()].Num() == 0) {
+		return;
+	}
+	TArray<FGoodsQuantity>& IngredientGoods = DeductedIngredientGoods[Block->GetGridSlot()];
+	// Return the block's ingredient goods to the grid's input inventory.
+	if (!InputGoodsInventory->AddSubtractGoodsArray(IngredientGoods, false)) {
+		UE_LOG(LogMMGame, Warning, TEXT("RecipePlayGrid::OnRandomBlockRemoved - cannot refund goods to grid input inventory for block type %s"), *Block->GetBlockType().Name.ToString());
+	}
+	IngredientGoods.Reset();
+	// The deduction may have removed the block's type from the ingredient odds.
+	if (!IngredientBlockDropOdds.Contains(Block->GetBlockType().Name)) {
+		InitIngredientBlockDropOdds(true);
+	}
+}
+
+
+const TArray<int16>& ARecipePlayGrid::GetSpawnableBlockTypeIds()
+{
+	// Reset keeps the allocation, and the ingredients can change as they are used, so rebuild the list each time.
+	SpawnableBlockTypeIds.Reset();
+	SpawnableBlockTypeIds.Append(Super::GetSpawnableBlockTypeIds());
+	const FBlockTypeRegistry* Registry = Board.GetBlockTypeRegistry();
+	if (Registry == nullptr) {
+		return SpawnableBlockTypeIds;
+	}
+	InitIngredientBlockDropOdds();
+	for (const FGoodsQuantity& IngredientOdds : IngredientBlockDropOdds)
+	{
+		const int16 TypeId = Registry->GetTypeId(IngredientOdds.Name);
+		if (Registry->IsValidId(TypeId)) {
+			SpawnableBlockTypeIds.AddUnique(TypeId);
+		}
+	}
+	return SpawnableBlockTypeIds;
 }
 
 
@@ -292,6 +342,7 @@ void ARecipePlayGrid::InitIngredientBlockDropOdds(const bool bForceRefresh)
 		UE_LOG(LogMMGame, Error, TEXT("RecipePlayGrid::InitIngredientGoodsDropOdds - Cannot get game mode"));
 		return;
 	}
+	FScopedGoodsDropperStream ScopedDropperStream(GameMode->GetGoodsDropper(), RandStream);
 	TArray<FGoodsQuantity> CraftingInputs = GetRecipe().CraftingInputs;
 	IngredientBlockDropOdds.Empty();
 	UE_CLOG(bDebugLog, LogMMGame, Log, TEXT("RecipePlayGrid::InitIngredientGoodsDropOdds - Init for recipe: %s with %d ingredients"), *GetRecipe().Name.ToString(), CraftingInputs.Num());
@@ -299,13 +350,13 @@ void ARecipePlayGrid::InitIngredientBlockDropOdds(const bool bForceRefresh)
 	for (int32 i = 0; i < CraftingInputs.Num(); i++)
 	{
 		bool bFound;
-		FBlockType BlockType;
 		FGoodsQuantity IngredientGoods = CraftingInputs[i];
-		if (!GameMode->GetBlockTypeByName(IngredientGoods.Name, BlockType)) {
+		const FBlockType* BlockType = GameMode->GetBlockTypeByName(IngredientGoods.Name);
+		if (BlockType == nullptr) {
 			UE_LOG(LogMMGame, Error, TEXT("RecipePlayGrid::InitIngredientGoodsDropOdds - Cannot get block type name for goods %s"), *IngredientGoods.Name.ToString());
 			continue;
 		}
-		TArray<FGoodsQuantity> BlockAwardGoods = GameMode->GetGoodsDropper()->EvaluateGoodsDropSet(BlockType.MatchDropGoods, 0.5f);
+		TArray<FGoodsQuantity> BlockAwardGoods = GameMode->GetGoodsDropper()->EvaluateGoodsDropSet(BlockType->MatchDropGoods, 0.5f);
 		if (!bIngredientsFromInventory || InputGoodsInventory->HasAllGoods(BlockAwardGoods))
 		{
 			float IngredientBlockAward = UGoodsFunctionLibrary::CountInGoodsQuantityArray(IngredientGoods.Name, BlockAwardGoods, bFound);
@@ -12,6 +12,12 @@ struct BlockCategory
 	static const FName Goods;
 };
 
+struct BlockMatchCode
+{
+	// The predefined match code that matches any other block.
+	static const FName Any;
+};
+
 /*
 * Represents a type of Block that can be spawned into the play grid.
 */
@@ -130,8 +136,7 @@ public:
 	{
 		if (MatchCode == NAME_None || MatchCodeOther == NAME_None) return false;
 		if (bPreventSelfMatch && MatchCode == MatchCodeOther) return false;
-		const FName Any = FName(TEXT("Any"));
-		if (MatchCode == Any || MatchCodeOther == Any) return true;
+		if (MatchCode == BlockMatchCode::Any || MatchCodeOther == BlockMatchCode::Any) return true;
 		if (MatchCode == MatchCodeOther) return true;
 		for (FName MyOtherMC : OtherMatchCodes) {
 			if (MyOtherMC == MatchCodeOther) return true;
@@ -143,8 +148,7 @@ public:
 	{
 		if (MatchCode == NAME_None || MatchCodeOther == NAME_None) return false;
 		if (bPreventSelfMatch && MatchCode == MatchCodeOther) return false;
-		const FName Any = FName(TEXT("Any"));
-		if (MatchCode == Any || MatchCodeOther == Any) return true;
+		if (MatchCode == BlockMatchCode::Any || MatchCodeOther == BlockMatchCode::Any) return true;
 		if (MatchCode == MatchCodeOther) return true;
 		for (FName MyOtherMC : OtherMatchCodes) {
 			if (MyOtherMC == MatchCodeOther) return true;
@@ -156,8 +160,7 @@ public:
 	{
 		if (MatchCode == NAME_None || MatchCodeOther == NAME_None) return false;
 		if (bPreventSelfMatch && MatchCode == MatchCodeOther) return false;
-		const FName Any = FName(TEXT("Any"));
-		if (MatchCode == Any || MatchCodeOther == Any) return true;
+		if (MatchCode == BlockMatchCode::Any || MatchCodeOther == BlockMatchCode::Any) return true;
 		if (MatchCode == MatchCodeOther) return true;
 		for (FName MyOtherMC : OtherMatchCodes) {
 			if (MyOtherMC == MatchCodeOther) return true;
@@ -311,7 +314,15 @@ public:
 	UPROPERTY(BlueprintReadWrite)
 	bool bForInitialFill = false;
 
-	/** Block names to exclude, if possible. */
+	/** The block is placed where it has already settled, such as from a board resolved by AMMPlayGrid::ResolveMoveInstant. It is not unsettled. */
+	UPROPERTY(BlueprintReadWrite)
+	bool bAlreadySettled = false;
+
+	/** Block names to exclude, if possible. May be ignored for DuplicateSpawnPreventionFactor. */
 	UPROPERTY(BlueprintReadWrite)
 	TArray<FName> ExcludedBlockNames;
+
+	/** Block names that must not be picked, such as types that would complete a match when preventing matches. Never ignored. */
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FName> ForbiddenBlockNames;
 };
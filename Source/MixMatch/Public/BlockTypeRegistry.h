@@ -0,0 +1,105 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BlockType.h"
+
+/**
+ * Interns block types to small integer ids and precomputes which types match each other.
+ * Built once from the BlocksTable by the game mode. After that, a match test between two
+ * block types is a single bit lookup instead of a walk over match codes and categories.
+ * The registry owns the one copy of each block type. Blocks and grids keep an id and read
+ * the type through GetType() instead of holding their own copies.
+ */
+struct MIXMATCH_API FBlockTypeRegistry
+{
+public:
+
+	/** Id returned for block types that are not in the registry. */
+	static const int16 InvalidId;
+
+	/** Rebuild the registry from the given block types, keyed by block type name. */
+	void Build(const TMap<FName, FBlockType>& BlockTypes);
+
+	void Reset();
+
+	/** Number of block types in the registry. Valid ids are 0 to Num() - 1. */
+	FORCEINLINE int32 Num() const { return Names.Num(); }
+
+	FORCEINLINE bool IsValidId(const int16 TypeId) const { return TypeId >= 0 && TypeId < Names.Num(); }
+
+	/** Get the id for the block type with the given name. Returns InvalidId if not found. */
+	int16 GetTypeId(const FName& BlockTypeName) const;
+
+	/** Get the name of the block type with the given id. */
+	FName GetTypeName(const int16 TypeId) const;
+
+	/** Get the block type with the given id. Returns nullptr if the id is not valid.
+	 *  The returned type is valid until the registry is rebuilt. */
+	FORCEINLINE const FBlockType* GetType(const int16 TypeId) const
+	{
+		return IsValidId(TypeId) ? &Types[TypeId] : nullptr;
+	}
+
+	/** Get the block type with the given name. Returns nullptr if not found. */
+	const FBlockType* FindType(const FName& BlockTypeName) const;
+
+	/** All block types, indexed by id. */
+	FORCEINLINE const TArray<FBlockType>& GetTypes() const { return Types; }
+
+	/** Do blocks of the two types match each other? Equivalent to comparing the FBlockTypes with operator==. */
+	FORCEINLINE bool Matches(const int16 TypeA, const int16 TypeB) const
+	{
+		return IsValidId(TypeA) && IsValidId(TypeB) && CompatibilityBits[(TypeA * Names.Num()) + TypeB];
+	}
+
+	/** Is the type flagged bImmobile? */
+	FORCEINLINE bool IsImmobile(const int16 TypeId) const
+	{
+		return IsValidId(TypeId) && ImmobileBits[TypeId];
+	}
+
+	/** True if the types can be split into match classes: every type matches exactly the types in its own class, or nothing at all.
+	 *  Not true if any type matches across groups (ex: an "Any" match code) or is bMatchNextToPreviousInMatchGroup. */
+	FORCEINLINE bool HasMatchClasses() const { return NumMatchClasses > 0; }
+
+	FORCEINLINE int32 GetNumMatchClasses() const { return NumMatchClasses; }
+
+	/** Get the match class of the type. INDEX_NONE if the type matches nothing or the registry has no match classes. */
+	FORCEINLINE int16 GetMatchClass(const int16 TypeId) const
+	{
+		return IsValidId(TypeId) && HasMatchClasses() ? MatchClasses[TypeId] : (int16)INDEX_NONE;
+	}
+
+	/** Is the type flagged bMatchNextToPreviousInMatchGroup? */
+	FORCEINLINE bool IsMatchNextToPrevious(const int16 TypeId) const
+	{
+		return IsValidId(TypeId) && MatchNextToPreviousBits[TypeId];
+	}
+
+private:
+
+	/** Block type names, indexed by id. */
+	TArray<FName> Names;
+
+	/** Block types, indexed by id. Not changed after Build. */
+	TArray<FBlockType> Types;
+
+	TMap<FName, int16> Ids;
+
+	/** N x N matrix. Bit (A * N) + B is set if type A matches type B. */
+	TBitArray<> CompatibilityBits;
+
+	/** Bit per type id, set if the type is bMatchNextToPreviousInMatchGroup. */
+	TBitArray<> MatchNextToPreviousBits;
+
+	/** Bit per type id, set if the type is bImmobile. */
+	TBitArray<> ImmobileBits;
+
+	/** Match class of each type id. See HasMatchClasses() */
+	TArray<int16> MatchClasses;
+
+	int32 NumMatchClasses = 0;
+
+	/** Group the types into match classes if the compatibility matrix allows it. */
+	void BuildMatchClasses();
+};
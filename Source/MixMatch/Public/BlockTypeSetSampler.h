@@ -0,0 +1,75 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BlockType.h"
+#include "BlockTypeRegistry.h"
+#include "MMAliasTable.h"
+
+/**
+ * Picks weighted random block types from one FWeightedBlockTypeSet.
+ * Holds an alias table for the whole set, plus one for each combination of excluded entries that has been asked for,
+ * so a pick is constant time and does not allocate once the common exclusions have been seen.
+ */
+struct MIXMATCH_API FBlockTypeSetSampler
+{
+public:
+
+	/** Sets with more entries than this do not cache exclusion tables. */
+	static const int32 MaxMaskedEntries = 64;
+
+	/** Most exclusion tables kept per set. */
+	static const int32 MaxExclusionTables = 64;
+
+	/** Rebuild from the given set. Block type names not in the registry are skipped. */
+	void Build(const FWeightedBlockTypeSet& BlockTypeSet, const FBlockTypeRegistry& Registry);
+
+	FORCEINLINE FName GetSetName() const { return SetName; }
+
+	FORCEINLINE int32 Num() const { return BlockTypeNames.Num(); }
+
+	/** Registry id of each block type in the set. */
+	FORCEINLINE const TArray<int16>& GetTypeIds() const { return TypeIds; }
+
+	/** Pick a random block type name, weighted, drawing from the given stream.
+	 *  If all allowed types are excluded, a type that is not forbidden and is allowed by bPreventImmobile is picked, unweighted.
+	 *  Forbidden types are never picked. Returns NAME_None if nothing can be picked. */
+	FName Pick(const TArray<FName>& ExcludedBlockNames, const TArray<FName>& ForbiddenBlockNames, const bool bPreventImmobile, FRandomStream& RandStream);
+
+	/** Unweighted pick of a block type that is not forbidden, and not immobile if bPreventImmobile. Returns NAME_None if nothing can be picked. */
+	FName PickFallback(const TArray<FName>& ForbiddenBlockNames, const bool bPreventImmobile, FRandomStream& RandStream) const;
+
+private:
+
+	FName SetName;
+
+	/** Block type of each entry. */
+	TArray<FName> BlockTypeNames;
+
+	/** Registry id of each entry's block type. */
+	TArray<int16> TypeIds;
+
+	/** Entry index of each block type name, so excluded names are found without searching. */
+	TMap<FName, int32> EntryIndexes;
+
+	/** Weight of each entry. */
+	TArray<float> Weights;
+
+	/** Bit per entry, set if the block type is immobile. */
+	TBitArray<> ImmobileBits;
+
+	/** Same as ImmobileBits, as a mask. Only used if Num() <= MaxMaskedEntries. */
+	uint64 ImmobileMask = 0;
+
+	FMMAliasTable AllTypesTable;
+
+	/** Tables with some entries removed, keyed by the mask of removed entries. */
+	TMap<uint64, FMMAliasTable> ExclusionTables;
+
+	FORCEINLINE bool IsAllowed(const int32 Index, const TArray<FName>& ExcludedBlockNames, const TArray<FName>& ForbiddenBlockNames, const bool bPreventImmobile) const
+	{
+		return !(bPreventImmobile && ImmobileBits[Index]) && !ExcludedBlockNames.Contains(BlockTypeNames[Index]) && !ForbiddenBlockNames.Contains(BlockTypeNames[Index]);
+	}
+
+	/** Build a table with only the allowed entries. */
+	void BuildExclusionTable(const TArray<FName>& ExcludedBlockNames, const TArray<FName>& ForbiddenBlockNames, const bool bPreventImmobile, FMMAliasTable& OutTable) const;
+};
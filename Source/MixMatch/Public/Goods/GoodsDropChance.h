@@ -29,6 +29,7 @@ public:
 
 	// Array of names of GoodsDropSets to also be evaluated and included during drop.
 	// Caution: do not create a GoodsDropSet that contains a GoodsDropChance that references it's own GoodsDropSet. (i.e. don't create circular references)
+	// The goods dropper logs an error for each reference that would close a cycle and ignores it.
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, SaveGame)
 		TArray<FName> OtherGoodsDrops;
 };
\ No newline at end of file
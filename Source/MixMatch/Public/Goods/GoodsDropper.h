@@ -10,6 +10,35 @@
 #include "GoodsDropSet.h"
 #include "GoodsDropper.generated.h"
 
+
+// A drop chance of a drop set in the dropper's library, with its other goods drops resolved to compiled drop set indexes.
+struct FCompiledGoodsDropChance
+{
+	const FGoodsDropChance* DropChance = nullptr;
+
+	// Index in the compiled drop sets of each found entry of OtherGoodsDrops. References that would make a cycle are left out.
+	TArray<int32> OtherDropSets;
+};
+
+
+// A drop set in the dropper's library, compiled for evaluation without name lookups.
+struct FCompiledGoodsDropSet
+{
+	const FGoodsDropSet* DropSet = nullptr;
+
+	// This set's drop chances are CompiledDropChances[FirstChance] to CompiledDropChances[FirstChance + NumChances - 1].
+	int32 FirstChance = 0;
+	int32 NumChances = 0;
+
+	// Only set if bAsWeightedList. Sum of the absolute value of all chances. Negative chances make a chance of dropping nothing.
+	float TotalWeight = 0.0f;
+
+	// Only set if bAsWeightedList. Running total of the positive chances, and the index of each positive chance in CompiledDropChances.
+	// A weighted pick takes the first entry whose running total reaches the picked weight.
+	TArray<float> CumulativeWeights;
+	TArray<int32> CumulativeChances;
+};
+
 /**
  * Provides functionaly to evaluate groups of drop sets (FGoodsDropSet).
  * Each goods drop set is a collection of goods drop chances.
@@ -41,6 +70,10 @@ public:
 
 	UFUNCTION(BlueprintCallable, Category = "Goods")
 	void SeedRandomStream(const int32 NewSeed);
+
+	// Draw from the given stream instead of our own random stream. Pass nullptr to go back to our own.
+	// Returns the previous override. See FScopedGoodsDropperStream.
+	FRandomStream* SetRandomStreamOverride(FRandomStream* NewStream);
 		
 	// Evaluate this drop set and return all Goods droppped.
 	UFUNCTION(BlueprintCallable, Category = "Goods")
@@ -64,10 +97,72 @@ private:
 	// Our random stream.  Use SeedRandomStream to set this if needed.
 	FRandomStream RandStream;
 
+	// Stream used instead of RandStream, if not null.
+	FRandomStream* RandStreamOverride = nullptr;
+
+	// The stream to draw from. RandStreamOverride if set, otherwise RandStream.
+	FORCEINLINE FRandomStream& GetRandStream() { return RandStreamOverride ? *RandStreamOverride : RandStream; }
+
 	// Our collection of DataTables, each containing GoodsDropSet rows
 	TArray<UDataTable*> DropTableLibrary;
-	
-	// Find the GoodsDropTable data in the DropTableLibrary that has the given name.
-	const FGoodsDropSet* FindDropSetInLibrary(const FName DropSetName) const;
 
+	// All drop sets in the library, compiled. Rebuilt when first needed after the library changes.
+	TArray<FCompiledGoodsDropSet> CompiledDropSets;
+
+	// Drop chances of all compiled drop sets. See FCompiledGoodsDropSet::FirstChance.
+	TArray<FCompiledGoodsDropChance> CompiledDropChances;
+
+	// Index in CompiledDropSets of each drop set, by row name.
+	TMap<FName, int32> CompiledDropSetIndexes;
+
+	// False if the library has changed since the drop sets were compiled.
+	bool bDropSetsCompiled = false;
+
+	// Compile all drop sets in the library, resolving other goods drops by name and breaking any reference cycles.
+	void CompileDropSets();
+
+	// Remove references that lead back to a drop set that is still being visited. Depth first from the given drop set.
+	// VisitState per drop set: 0 = not visited, 1 = being visited, 2 = done.
+	void BreakDropSetCycles(const int32 DropSetIndex, TArray<uint8>& VisitState);
+
+	// Index in CompiledDropSets of the drop set with the given name, or INDEX_NONE.
+	int32 FindCompiledDropSet(const FName DropSetName);
+
+	// Compiled drop sets point into the table rows, so recompile when a table in the library changes.
+	void OnDropTableChanged();
+
+	// Evaluate a compiled drop set, adding all goods dropped to OutGoods.
+	void EvaluateCompiledDropSet(const int32 DropSetIndex, const float QuantityScale, TArray<FGoodsQuantity>& OutGoods);
+
+	// Add a random drop of the goods from a compiled drop chance to OutGoods.
+	void GoodsForCompiledDropChance(const FCompiledGoodsDropChance& CompiledChance, const float QuantityScale, TArray<FGoodsQuantity>& OutGoods);
+
+};
+
+
+/**
+ * Makes a goods dropper draw from the given random stream until the end of the scope.
+ * Lets each play grid keep its goods drops on its own seeded stream.
+ */
+struct MIXMATCH_API FScopedGoodsDropperStream
+{
+public:
+	FScopedGoodsDropperStream(UGoodsDropper* InGoodsDropper, FRandomStream& Stream)
+		: GoodsDropper(InGoodsDropper)
+	{
+		if (GoodsDropper) {
+			PreviousStream = GoodsDropper->SetRandomStreamOverride(&Stream);
+		}
+	}
+
+	~FScopedGoodsDropperStream()
+	{
+		if (GoodsDropper) {
+			GoodsDropper->SetRandomStreamOverride(PreviousStream);
+		}
+	}
+
+private:
+	UGoodsDropper* GoodsDropper;
+	FRandomStream* PreviousStream = nullptr;
 };
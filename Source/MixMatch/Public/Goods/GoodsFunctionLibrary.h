@@ -116,7 +116,7 @@ public:
 		{
 			return nullptr;
 		}
-		PickedWeight = FMath::FRandRange(0.0, TotalWeightedChance);
+		PickedWeight = RandStream.FRandRange(0.0, TotalWeightedChance);
 		//UE_LOG(LogMMGame, Log, TEXT("PickOne total weight: %f  picked weight %f"), TotalWeightedChance, PickedWeight);
 
 		// Iterate through our list of items until we find the first one where the overall PickedWeight is less than our cumulative total weight of items iterated so far.
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Weighted random picks in constant time, using Vose's alias method.
+ * Build once from a list of weights, then each Sample() costs two random numbers and one table lookup.
+ * Weights <= 0 are never picked.
+ */
+struct MIXMATCH_API FMMAliasTable
+{
+public:
+
+	/** Rebuild the table from the given weights. Entry indexes in the table match indexes in Weights. */
+	void Build(const TArray<float>& Weights);
+
+	void Reset();
+
+	/** Number of entries in the table, including entries that cannot be picked. */
+	FORCEINLINE int32 Num() const { return Probability.Num(); }
+
+	/** True if at least one entry has a weight > 0. */
+	FORCEINLINE bool CanSample() const { return TotalWeight > 0.f; }
+
+	/** Sum of all weights > 0. */
+	FORCEINLINE float GetTotalWeight() const { return TotalWeight; }
+
+	/** Pick a random entry index, weighted, drawing from the given stream. Returns INDEX_NONE if nothing can be picked. */
+	int32 Sample(FRandomStream& RandStream) const;
+
+private:
+
+	/** Chance of keeping each column's own entry instead of its alias. */
+	TArray<float> Probability;
+
+	/** Entry picked for each column when its own entry is not kept. */
+	TArray<int32> Alias;
+
+	float TotalWeight = 0.f;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MMEnums.h"
+
+/**
+ * One bit per cell of a grid, stored as a 64 bit mask per row. Bit X of row Y is the cell at coords (X, Y).
+ * Grids up to MaxSizeX wide are supported. Set operations, shifts and neighbor dilation work on whole rows at a time.
+ */
+struct MIXMATCH_API FMMBitBoard
+{
+public:
+
+	/** Widest grid a bitboard can represent. */
+	static const int32 MaxSizeX = 64;
+
+	FMMBitBoard();
+
+	FMMBitBoard(const int32 InSizeX, const int32 InSizeY);
+
+	static FORCEINLINE bool SupportsSize(const int32 InSizeX, const int32 InSizeY) { return InSizeX > 0 && InSizeX <= MaxSizeX && InSizeY > 0; }
+
+	/** Resize the bitboard. All bits are cleared. */
+	void Init(const int32 InSizeX, const int32 InSizeY);
+
+	/** Clear all bits. */
+	void Reset();
+
+	FORCEINLINE int32 GetSizeX() const { return SizeX; }
+	FORCEINLINE int32 GetSizeY() const { return Rows.Num(); }
+
+	FORCEINLINE bool Get(const FIntPoint& Coords) const { return (Rows[Coords.Y] >> Coords.X) & 1ULL; }
+
+	FORCEINLINE void Set(const FIntPoint& Coords, const bool bValue)
+	{
+		if (bValue) {
+			Rows[Coords.Y] |= 1ULL << Coords.X;
+		}
+		else {
+			Rows[Coords.Y] &= ~(1ULL << Coords.X);
+		}
+	}
+
+	FORCEINLINE uint64 GetRow(const int32 Y) const { return Rows[Y]; }
+
+	/** Are no bits set? */
+	bool IsEmpty() const;
+
+	/** Number of bits set. */
+	int32 Num() const;
+
+	/** Set the bits along a straight line of cells starting at StartCoords and going East (horizontal) or North (vertical). */
+	void SetLine(const FIntPoint& StartCoords, const EMMOrientation Orientation, const int32 Length);
+
+	/** Each bit moved one cell in the given direction. Bits moved off the grid are dropped. */
+	FMMBitBoard Shifted(const EMMDirection Direction) const;
+
+	/** The set bits plus all of their neighbors. */
+	FMMBitBoard Dilated(const bool bIncludeDiagonal = false) const;
+
+	/** Cells that are not set but are next to a set cell. */
+	FMMBitBoard Neighbors(const bool bIncludeDiagonal = false) const;
+
+	/** Bits set at the first (West/South most) cell of every line of at least Length consecutive set cells along the orientation. */
+	FMMBitBoard RunStarts(const int32 Length, const EMMOrientation Orientation) const;
+
+	/** Add the coords of all set bits, from bottom left to top right. */
+	void GetSetCoords(TArray<FIntPoint>& OutCoords) const;
+
+	FMMBitBoard operator&(const FMMBitBoard& Other) const;
+	FMMBitBoard operator|(const FMMBitBoard& Other) const;
+	FMMBitBoard operator~() const;
+	FMMBitBoard& operator&=(const FMMBitBoard& Other);
+	FMMBitBoard& operator|=(const FMMBitBoard& Other);
+
+private:
+
+	/** Bits valid in each row. */
+	FORCEINLINE uint64 RowMask() const { return SizeX >= 64 ? ~0ULL : (1ULL << SizeX) - 1ULL; }
+
+	int32 SizeX;
+
+	TArray<uint64> Rows;
+};
@@ -7,6 +7,7 @@
 #include "MMEnums.h"
 #include "BlockMatch.h"
 #include "BlockType.h"
+#include "BlockTypeRegistry.h"
 #include "MMPlayGridCell.h"
 #include "MMBlock.generated.h"
 
@@ -95,13 +96,27 @@ public:
 	/** Is this block currently falling from above the grid into the grid play space? */
 	bool bFallingIntoGrid;
 
+	/** The grid's instanced mesh drawing this block, if the grid instances block meshes. See AMMPlayGrid::bInstanceBlockMeshes */
+	UPROPERTY()
+	class UInstancedStaticMeshComponent* RenderInstanceComponent = nullptr;
+
+	/** Index of this block's instance in RenderInstanceComponent. */
+	int32 RenderInstanceIndex = INDEX_NONE;
+
 protected:
 
-	/* BlockType containing most of the properties describing this block.
-	 * Comes from data object. (DataTable) */
-	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Block)
+	/* Only set if the BlockType passed to SetBlockType is not registered, and then holds this block's type.
+	 * Empty for registered types. Use GetBlockType(), which returns the registered record. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Block, meta = (DeprecatedProperty, DeprecationMessage = "Use GetBlockType()"))
 	FBlockType BlockType;
 
+	/** Id of this block's type in the game mode's block type registry. Set in SetBlockType.
+	 *  The registry holds the BlockType containing most of the properties describing this block. See GetBlockType() */
+	int16 BlockTypeId = FBlockTypeRegistry::InvalidId;
+
+	/** Registry that BlockTypeId belongs to. Owned by the game mode. */
+	const FBlockTypeRegistry* BlockTypeRegistry = nullptr;
+
 	UPROPERTY(BlueprintReadOnly, Category = Block)
 	int32 CurrentHealth;
 	
@@ -111,8 +126,16 @@ protected:
 	 * This is typically the distance between two cells since blocks settle cell to adjacent cell. */
 	float StartMoveDistance;
 
-	/** Our timer handle for the delay between block unsettled to block begins settling. */
-	FTimerHandle SettleFallDelayHandle;
+	/** Current straight line movement, relative to the grid. The block's location is a function of the time since MoveStartTime. See UpdateMovement() */
+	FVector MoveStartLocation;
+	FVector MoveEndLocation;
+	float MoveStartTime = 0.f;
+
+	/** Is this block unsettled and waiting for its SettleFallDelay to pass before it starts settling? */
+	bool bWaitingToSettle = false;
+
+	/** World time when a block that is bWaitingToSettle starts settling. */
+	float SettleStartTime = 0.f;
 
 	UPROPERTY(BlueprintReadWrite)
 	class UMaterialInstanceDynamic* BaseMatDynamic = nullptr;
@@ -122,6 +145,12 @@ protected:
 	/** Some basic protection for errors when attempting to settle this block */
 	int32 BlockSettleFails = 0;
 
+	/** Is this block deactivated and waiting in the grid's block pool? */
+	bool bPooled = false;
+
+	/** See GetGridSlot() */
+	int32 GridSlot = INDEX_NONE;
+
 	/** Output verbose logging for blocks */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Block)
 	bool bDebugLog = true;
@@ -137,12 +166,12 @@ private:
 	//#######  FUNCTIONS  #######
 public:
 
-	virtual void Tick(float DeltaSeconds) override;
-
+	/** Called by the grid each tick while this block is moving. */
 	UFUNCTION(BlueprintNativeEvent)
 	bool MoveTick(float DeltaSeconds);
 
-	/** Base class does nothing but call MatchFinished on all current matches that this block is in. 
+	/** Called by the grid each tick while this block is matching.
+	 *  Base class does nothing but call MatchFinished on all current matches that this block is in. 
 	 *  Subclasses should override this with meaningful implementation. (see BlockBase blueprint)*/
 	UFUNCTION(BlueprintNativeEvent)
 	bool MatchTick(float DeltaSeconds);
@@ -152,13 +181,18 @@ public:
 	bool SettleTick(float DeltaSeconds);
 
 	/** Should only be called once. Currently changing an existing block's type is not handled.
-	 *  (And is probably never necessary.) */
+	 *  (And is probably never necessary.)
+	 *  GetBlockType() returns the registered block type with the same name. NewBlockType is only used if that type is not registered. */
 	UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
 	void SetBlockType(const FBlockType& NewBlockType);
 
-	UFUNCTION(BlueprintPure)
+	/** The registered block type of this block, or the type passed to SetBlockType if it is not registered. */
+	UFUNCTION(BlueprintPure, Category = Block)
 	const FBlockType& GetBlockType() const;
 
+	/** Id of this block's type in the game mode's block type registry. */
+	FORCEINLINE int16 GetBlockTypeId() const { return BlockTypeId; }
+
 	/** Get this block's current grid coordinates. */
 	UFUNCTION(BlueprintPure)
 	FIntPoint GetCoords() const;
@@ -193,8 +227,6 @@ public:
 	UFUNCTION(BlueprintPure)
 	bool IsIndestructible() const;
 
-	AMMPlayGridCell* FindSettleCell();
-
 	/** Move this block to the given cell.If the cell is not occupied this will set OwningGridCell, otherwise this will set SettleToCell. */
 	UFUNCTION(BlueprintCallable)
 	bool ChangeOwningGridCell(AMMPlayGridCell* ToCell);
@@ -222,6 +254,29 @@ public:
 	/** Destroys block actor. Only cleans up itself. i.e. grid, etc. must clean their own refs, etc. */
 	void DestroyBlock();
 
+	/** Cleans up the block like DestroyBlock, but keeps the actor so the grid can reuse it. 
+	 *  The block is hidden, detached from the grid and stops ticking and colliding. Its timers and latent actions are cleared. */
+	void DeactivateBlock();
+
+	/** Returns a deactivated block to the state of a newly spawned block, including its mesh, mesh transform and materials. SetBlockType should be called after this. */
+	void ActivateBlock();
+
+	/** Is this block deactivated and waiting in the grid's block pool? */
+	FORCEINLINE bool IsPooled() const { return bPooled; }
+
+	/** Is this block unsettled and waiting for its settle delay to pass? The grid calls OnSettle once the time reaches GetSettleStartTime(). */
+	FORCEINLINE bool IsWaitingToSettle() const { return bWaitingToSettle; }
+
+	FORCEINLINE float GetSettleStartTime() const { return SettleStartTime; }
+
+	/** Small id of this block, unique among the blocks spawned by its grid and kept while the block is pooled. Used to index the grid's block sets. */
+	FORCEINLINE int32 GetGridSlot() const { return GridSlot; }
+
+	FORCEINLINE void SetGridSlot(const int32 NewGridSlot) { GridSlot = NewGridSlot; }
+
+	/** Write this block's color and damage to the per instance custom data of its mesh instance. */
+	void UpdateRenderInstanceData();
+
 	/** Get the goods dropped for a "normal", minimum size, block match. */
 	UFUNCTION(BlueprintNativeEvent)
 	TArray<FGoodsQuantity> GetBaseMatchGoods(const UGoodsDropper* GoodsDropper, const float QuantityScale = -1.f) const;
@@ -229,6 +284,9 @@ public:
 	/** Get the goods dropped for the given match. */
 	UFUNCTION(BlueprintNativeEvent)
 	TArray<FGoodsQuantity> GetMatchGoods(const UGoodsDropper* GoodsDropper, const UBlockMatch* Match);
+
+	/** Apply a block type's bonus goods multiplier to its base match goods, for a match BonusMatchSize blocks over the minimum match size. */
+	static TArray<FGoodsQuantity> ScaleMatchGoods(const TArray<FGoodsQuantity>& BaseMatchGoods, const FBlockType& MatchedBlockType, const int32 BonusMatchSize);
 	
 	/** Notifications from the grid to this block */
 
@@ -249,6 +307,10 @@ public:
 	UFUNCTION(BlueprintNativeEvent)
 	void OnBlockDestroyed();
 
+	/** Grid calls when the block is deactivated and put in the block pool. Blueprints should reset any state they keep for the block, so it can be reused. */
+	UFUNCTION(BlueprintNativeEvent)
+	void OnBlockPooled();
+
 	/** Grid calls when block is unsettled. */
 	UFUNCTION(BlueprintNativeEvent)
 	void OnUnsettle();
@@ -292,6 +354,15 @@ protected:
 	UFUNCTION(BlueprintNativeEvent)
 	void UpdateBlockVis();
 
+	/** Start moving in a straight line from the current location to this block's cell. */
+	void BeginMovement();
+
+	/** Move the end of the current movement to this block's cell, keeping its start. Used when a settling block finds a lower cell. */
+	void ExtendMovement();
+
+	/** Set this block's location for the current time along its movement. Returns true if the movement is complete. */
+	bool UpdateMovement();
+
 	virtual void BeginPlay() override;
 
 public:
@@ -317,3 +388,42 @@ public:
 };
 
 
+/** Set of blocks with constant time add, remove and contains. Used for the grid's block bookkeeping.
+ *  Blocks are indexed by their grid slot. See AMMBlock::GetGridSlot()
+ *  Removing a block moves the last block into its place, so the order of Blocks is only kept while blocks are added. */
+USTRUCT(BlueprintType)
+struct FMMBlockSlotSet
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadOnly)
+	TArray<AMMBlock*> Blocks;
+
+	/** Returns true if the block was added, false if it was already in the set. */
+	bool Add(AMMBlock* Block);
+
+	/** Returns true if the block was in the set. */
+	bool Remove(const AMMBlock* Block);
+
+	bool Contains(const AMMBlock* Block) const;
+
+	void Empty();
+
+	FORCEINLINE int32 Num() const { return Blocks.Num(); }
+	FORCEINLINE bool IsValidIndex(const int32 Index) const { return Blocks.IsValidIndex(Index); }
+	FORCEINLINE AMMBlock* operator[](const int32 Index) const { return Blocks[Index]; }
+
+	FORCEINLINE auto begin() { return Blocks.begin(); }
+	FORCEINLINE auto end() { return Blocks.end(); }
+	FORCEINLINE auto begin() const { return Blocks.begin(); }
+	FORCEINLINE auto end() const { return Blocks.end(); }
+
+private:
+
+	/** Position of each block in Blocks, indexed by grid slot. INDEX_NONE for blocks not in the set. */
+	TArray<int32> Positions;
+};
+
+
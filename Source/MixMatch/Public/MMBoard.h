@@ -0,0 +1,305 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MMEnums.h"
+#include "BlockTypeRegistry.h"
+#include "MMBitBoard.h"
+
+/** State flags kept for each cell of an FMMBoard. */
+enum class EMMBoardCellFlags : uint8
+{
+	None				= 0,
+	// Block in the cell cannot be moved by the player or by settling.
+	Immobile			= 1 << 0,
+	// Block in the cell cannot be destroyed by game effects.
+	Indestructible		= 1 << 1,
+	// Block in the cell is already part of a horizontal match.
+	MatchedHorizontal	= 1 << 2,
+	// Block in the cell is already part of a vertical match.
+	MatchedVertical		= 1 << 3,
+	// Block in the cell is moving or settling, so it is not part of the stable board yet.
+	Unsettled			= 1 << 4
+};
+ENUM_CLASS_FLAGS(EMMBoardCellFlags)
+
+
+/** A run of matching blocks found on an FMMBoard. */
+struct FMMBoardMatch
+{
+	/** Coordinates of the first block in the run, the one closest to coords (0,0). */
+	FIntPoint StartCoords = FIntPoint::NoneValue;
+
+	/** Horizontal runs extend East from StartCoords, vertical runs extend North. */
+	EMMOrientation Orientation = EMMOrientation::Unknown;
+
+	/** Number of blocks in the run. */
+	int32 Length = 0;
+
+	FORCEINLINE FIntPoint GetCoords(const int32 Offset) const
+	{
+		return Orientation == EMMOrientation::Horizontal ? FIntPoint(StartCoords.X + Offset, StartCoords.Y) : FIntPoint(StartCoords.X, StartCoords.Y + Offset);
+	}
+};
+
+
+/** Everything that happened while resolving matches and cascades on an FMMBoard. See FMMBoard::ResolveCascades */
+struct FMMBoardCascadeResult
+{
+	/** Every match resolved, in the order found. */
+	TArray<FMMBoardMatch> Matches;
+
+	/** Type id of each block in each match. Matches[0]'s blocks come first, in run order. */
+	TArray<int16> MatchedTypes;
+
+	/** Number of matches found in each cascade step. The first step is the move itself. */
+	TArray<int32> StepMatchCounts;
+
+	int32 BlocksDestroyed = 0;
+
+	int32 BlocksAdded = 0;
+
+	FORCEINLINE int32 NumSteps() const { return StepMatchCounts.Num(); }
+};
+
+
+/**
+ * Headless model of a play grid's contents.
+ * Holds a dense block type id and a set of flags for each cell, indexed the same way as the grid's cells: Y * SizeX + X.
+ * All rule queries here work on plain arrays so they can be run without touching any actors.
+ * AMMPlayGrid owns one of these and keeps it in sync as blocks enter and leave its cells.
+ * Type ids are the ids from the game mode's FBlockTypeRegistry.
+ */
+struct MIXMATCH_API FMMBoard
+{
+public:
+
+	/** Type id stored in cells that do not contain a block. */
+	static const int16 EmptyType;
+
+	FMMBoard();
+
+	/** Resize the board to the given dimensions. All cells are cleared. */
+	void Init(const int32 InSizeX, const int32 InSizeY);
+
+	/** Clear all cells. */
+	void Reset();
+
+	FORCEINLINE int32 GetSizeX() const { return SizeX; }
+	FORCEINLINE int32 GetSizeY() const { return SizeY; }
+	FORCEINLINE int32 Num() const { return Types.Num(); }
+
+	FORCEINLINE bool IsValidCoords(const FIntPoint& Coords) const { return Coords.X >= 0 && Coords.X < SizeX && Coords.Y >= 0 && Coords.Y < SizeY; }
+	FORCEINLINE bool IsValidIndex(const int32 Index) const { return Types.IsValidIndex(Index); }
+	FORCEINLINE int32 ToIndex(const FIntPoint& Coords) const { return (Coords.Y * SizeX) + Coords.X; }
+	FORCEINLINE FIntPoint ToCoords(const int32 Index) const { return FIntPoint(Index % SizeX, Index / SizeX); }
+
+	//### Cell state
+
+	FORCEINLINE int16 GetType(const int32 Index) const { return Types[Index]; }
+	FORCEINLINE bool IsEmpty(const int32 Index) const { return Types[Index] == EmptyType; }
+	FORCEINLINE EMMBoardCellFlags GetFlags(const int32 Index) const { return Flags[Index]; }
+	FORCEINLINE bool HasFlags(const int32 Index, const EMMBoardCellFlags CheckFlags) const { return EnumHasAnyFlags(Flags[Index], CheckFlags); }
+
+	/** Set the block type and flags of a cell. */
+	void SetCell(const int32 Index, const int16 TypeId, const EMMBoardCellFlags NewFlags);
+
+	/** Mark a cell as not containing a block. */
+	void ClearCell(const int32 Index);
+
+	void AddFlags(const int32 Index, const EMMBoardCellFlags NewFlags);
+	void RemoveFlags(const int32 Index, const EMMBoardCellFlags OldFlags);
+
+	/** Is there a block in the cell that can be moved? */
+	bool IsMobile(const int32 Index) const;
+
+	/** Is there a block in the cell that is settled and can take part in a match? */
+	bool IsMatchable(const int32 Index) const;
+
+	/** True if no cells contain unsettled blocks. */
+	bool IsSettled() const;
+
+	//### Block types
+
+	/** Set the registry that cell type ids refer to. The registry must outlive the board. */
+	void SetBlockTypeRegistry(const FBlockTypeRegistry* NewRegistry);
+
+	FORCEINLINE const FBlockTypeRegistry* GetBlockTypeRegistry() const { return Registry; }
+
+	/** Do blocks of the two types match each other? */
+	FORCEINLINE bool TypesMatch(const int16 TypeA, const int16 TypeB) const { return Registry && Registry->Matches(TypeA, TypeB); }
+
+	/** Does the type compare against the previous non-wildcard block in a match group instead of its neighbor?
+	 *  See FBlockType::bMatchNextToPreviousInMatchGroup. */
+	FORCEINLINE bool IsMatchNextToPrevious(const int16 TypeId) const { return Registry && Registry->IsMatchNextToPrevious(TypeId); }
+
+	//### Matching
+
+	/** Number of blocks in the run of matching blocks that includes the given cell, along the given orientation.
+	 *  Returns 0 if the cell cannot be matched. */
+	int32 GetMatchRunLength(const int32 Index, const EMMOrientation Orientation) const;
+
+	/** Is the block in the given cell part of a horizontal or vertical run of at least MinMatchSize blocks? */
+	bool CellHasMatch(const int32 Index, const int32 MinMatchSize) const;
+
+	/** Scan every row and column once and add each run of at least MinMatchSize matching blocks to OutMatches.
+	 *  Cells already matched in a run's orientation are not included again.
+	 *  If OnlyRunsContaining is given (one bit per cell), only runs that include at least one set cell are added.
+	 *  Returns the number of matches added. */
+	int32 FindMatches(const int32 MinMatchSize, TArray<FMMBoardMatch>& OutMatches, const TBitArray<>* OnlyRunsContaining = nullptr) const;
+
+	/** Find the block types that would be part of a run of at least MinMatchSize if placed in the given cell.
+	 *  OutTypeIds gets one bit per registry type id, set for the types that would match. */
+	void GetTypesCompletingRun(const int32 Index, const int32 MinMatchSize, TBitArray<>& OutTypeIds) const;
+
+	/** Same as above, but only the given type ids are tried. */
+	void GetTypesCompletingRun(const int32 Index, const int32 MinMatchSize, const TArray<int16>& CandidateTypeIds, TBitArray<>& OutTypeIds) const;
+
+	/** Are per match class bitboards being kept for this board? 
+	 *  Requires the board to fit in an FMMBitBoard and the registry to have match classes. */
+	FORCEINLINE bool UsesBitBoards() const { return bUseBitBoards && Registry && ClassMasks.Num() == Registry->GetNumMatchClasses(); }
+
+	//### Move index
+
+	/** Bring the index of valid moves up to date. Only moves near cells that changed since the last update are re-evaluated.
+	 *  A move swaps two adjacent cells that are empty or hold mobile blocks, and is valid if it forms a run of at least MinMatchSize.
+	 *  Returns the number of valid moves on the board. */
+	int32 UpdateMoveIndex(const int32 MinMatchSize);
+
+	/** Number of valid moves as of the last UpdateMoveIndex. */
+	FORCEINLINE int32 GetValidMoveCount() const { return ValidMoveCount; }
+
+	/** Is swapping the cell with its neighbor in the given orthogonal direction a valid move? Only accurate after UpdateMoveIndex. */
+	bool IsValidMove(const int32 Index, const EMMDirection Direction) const;
+
+	/** Exchange the contents of two cells. */
+	void SwapCells(const int32 IndexA, const int32 IndexB);
+
+	//### Logic only resolve
+
+	/** Move mobile blocks down into the empty cells below them, as settling does. Blocks never fall past an immobile block.
+	 *  Returns the number of blocks moved. */
+	int32 ApplyGravity();
+
+	/** Fill each column's empty cells that are open to the top of the board, lowest first, with the type returned by GetRefillType(Index).
+	 *  A column stops filling if GetRefillType returns EmptyType. Returns the number of blocks added. */
+	int32 Refill(TFunctionRef<int16(const int32 Index)> GetRefillType);
+
+	/** Resolve all matches on the board to completion: destroy matched blocks, apply gravity, refill, and repeat while new matches form.
+	 *  Matched indestructible blocks stay and are flagged as matched so they are not matched again.
+	 *  Returns the number of cascade steps that had matches. */
+	int32 ResolveCascades(const int32 MinMatchSize, TFunctionRef<int16(const int32 Index)> GetRefillType, FMMBoardCascadeResult& OutResult, const int32 MaxSteps = 100);
+
+	/** Would swapping the contents of the two cells be a valid move? i.e. both are empty or hold mobile blocks and the swap forms a match.
+	 *  Evaluated on an FMMBoardOverlay, so the board is not changed. */
+	bool SwapHasMatch(const int32 IndexA, const int32 IndexB, const int32 MinMatchSize) const;
+
+protected:
+
+	/** Note that the cell changed so moves around it need to be re-evaluated. */
+	FORCEINLINE void MarkDirty(const int32 Index) 
+	{ 
+		DirtyCells[Index] = true;
+		bHasDirtyCells = true;
+	}
+
+	/** Rebuild all bitboards from the cell contents. */
+	void RebuildBitBoards();
+
+	/** Update the bitboard bits of a cell after it changed. OldType is the type id the cell had before the change. */
+	void UpdateBitBoards(const int32 Index, const int16 OldType);
+
+	/** Re-evaluate the moves from the cell to its East and North neighbors. */
+	void UpdateMovesFromCell(const int32 Index, const int32 MinMatchSize);
+
+	void SetMoveBit(const int32 BitIndex, const bool bValid);
+
+	/** Find the runs along a single row or column. Cell at Pos along the line has index LineStart + (Pos * Stride). */
+	void FindMatchesInLine(const int32 LineStart, const int32 Stride, const int32 LineLength, const EMMOrientation Orientation, const int32 MinMatchSize, TArray<FMMBoardMatch>& OutMatches, const TBitArray<>* OnlyRunsContaining) const;
+
+	int32 SizeX;
+	int32 SizeY;
+
+	/** Block type id of each cell. EmptyType if the cell has no block. */
+	TArray<int16> Types;
+
+	/** State flags of each cell. */
+	TArray<EMMBoardCellFlags> Flags;
+
+	/** Block type ids and match compatibility. Owned by the game mode. */
+	const FBlockTypeRegistry* Registry;
+
+	/** Two bits per cell: bit (Index * 2) is set if swapping with the East neighbor is a valid move, bit (Index * 2) + 1 for the North neighbor. */
+	TBitArray<> MoveBits;
+
+	/** Cells changed since the last UpdateMoveIndex. */
+	TBitArray<> DirtyCells;
+
+	bool bHasDirtyCells;
+
+	/** All moves need to be re-evaluated. ex: after Init or when the minimum match size changes. */
+	bool bMoveIndexInvalid;
+
+	int32 ValidMoveCount;
+
+	/** Minimum match size the move index was built with. */
+	int32 MoveIndexMatchSize;
+
+	bool bUseBitBoards;
+
+	/** For each match class of the registry, the cells holding a block of that class. */
+	TArray<FMMBitBoard> ClassMasks;
+
+	/** Cells that can still join a horizontal match. i.e. matchable and not already in a horizontal match. */
+	FMMBitBoard OpenHorizontal;
+
+	/** Cells that can still join a vertical match. */
+	FMMBitBoard OpenVertical;
+};
+
+
+/**
+ * A view of an FMMBoard with some cells changed, without modifying the board itself.
+ * Used to evaluate hypothetical moves with no side effects. Only valid while the board it was made from is not changed.
+ */
+struct MIXMATCH_API FMMBoardOverlay
+{
+public:
+
+	explicit FMMBoardOverlay(const FMMBoard& InBoard);
+
+	FORCEINLINE const FMMBoard& GetBoard() const { return Board; }
+
+	/** Override the block type and flags of a cell. */
+	void SetCell(const int32 Index, const int16 TypeId, const EMMBoardCellFlags NewFlags);
+
+	/** Exchange the contents of two cells. */
+	void SwapCells(const int32 IndexA, const int32 IndexB);
+
+	/** Remove all changes so the overlay matches the board again. */
+	void Reset();
+
+	int16 GetType(const int32 Index) const;
+	EMMBoardCellFlags GetFlags(const int32 Index) const;
+	FORCEINLINE bool HasFlags(const int32 Index, const EMMBoardCellFlags CheckFlags) const { return EnumHasAnyFlags(GetFlags(Index), CheckFlags); }
+	FORCEINLINE bool IsEmpty(const int32 Index) const { return GetType(Index) == FMMBoard::EmptyType; }
+	FORCEINLINE bool IsMobile(const int32 Index) const { return !IsEmpty(Index) && !HasFlags(Index, EMMBoardCellFlags::Immobile); }
+	FORCEINLINE bool IsMatchable(const int32 Index) const { return !IsEmpty(Index) && !HasFlags(Index, EMMBoardCellFlags::Unsettled); }
+
+	/** See FMMBoard::GetMatchRunLength */
+	int32 GetMatchRunLength(const int32 Index, const EMMOrientation Orientation) const;
+
+	/** See FMMBoard::CellHasMatch */
+	bool CellHasMatch(const int32 Index, const int32 MinMatchSize) const;
+
+private:
+
+	/** Position of the cell in the override arrays, or INDEX_NONE if the cell is not overridden. */
+	int32 FindOverride(const int32 Index) const;
+
+	const FMMBoard& Board;
+
+	// Overlays usually change only a couple of cells, so these are searched linearly.
+	TArray<int32, TInlineAllocator<4>> OverrideIndexes;
+	TArray<int16, TInlineAllocator<4>> OverrideTypes;
+	TArray<EMMBoardCellFlags, TInlineAllocator<4>> OverrideFlags;
+};
@@ -10,6 +10,8 @@
 #include "Goods/GoodsQuantity.h"
 #include "BlockMatch.h"
 #include "BlockType.h"
+#include "BlockTypeRegistry.h"
+#include "BlockTypeSetSampler.h"
 #include "MatchAction.h"
 //#include "MMPlayGridCell.h"
 #include "MMGameMode.generated.h"
@@ -78,18 +80,18 @@ protected:
 	class UGoodsDropper* GoodsDropper;
 
 	UPROPERTY()
-	FName CurrentWeightedBlockTypeSetName;
+	TMap<FName, FWeightedBlockTypeSet> WeightedBlockTypeSets;
 
-	UPROPERTY()
-	TMap<FName, FWeightedBlockTypeSet> CurrentWeightedBlockTypeSets;
-
-	UPROPERTY()
-	TArray<FWeightedBlockType> CurrentWeightedBlockTypes;
+	/** Weighted random pickers for each block type set that has been used. Keyed by set name.
+	 *  Shared with the grids using each set, so any number of sets can be in use at once. */
+	TMap<FName, TSharedPtr<FBlockTypeSetSampler>> BlockTypeSetSamplers;
 
-	float CurrentTotalBlockWeight;
+	/** All block types, with their ids and match compatibility. Built from BlocksTable. */
+	FBlockTypeRegistry BlockTypeRegistry;
 
+	/** Resolved block class of each block type, filled in when the Blocks asset group finishes loading. Keeps the classes loaded. */
 	UPROPERTY()
-	TMap<FName, FBlockType> CachedBlockTypes;
+	TMap<FName, TSubclassOf<AMMBlock>> LoadedBlockClasses;
 
 	UPROPERTY()
 	TMap<FName, FGoodsType> CachedGoodsTypes;
@@ -134,15 +136,28 @@ public:
 	UFUNCTION(BlueprintCallable)
 	class UGoodsDropper* GetGoodsDropper();
 
-	/** Retrieve the BlockType info with the given name. */
-	bool GetBlockTypeByName(const FName& BlockTypeName, FBlockType& FoundBlockType);
+	/** Retrieve the BlockType info with the given name. Returns nullptr if not found.
+	 *  The block type is owned by the block type registry. */
+	const FBlockType* GetBlockTypeByName(const FName& BlockTypeName);
+
+	/** Get the registry of block type ids and their match compatibility. */
+	const FBlockTypeRegistry& GetBlockTypeRegistry();
 	
-	/** Determine the block type name for spawning a new block. Play grids may default to this implementation but often have their own logic. */
-	bool GetRandomBlockTypeNameForCell(FName& FoundBlockTypeName, const FAddBlockContext& BlockContext);
+	/** Get the sampler for the block type set, building it on first use. Returns an invalid pointer if the set is not found.
+	 *  Grids keep the returned sampler. See AMMPlayGrid::GetBlockTypeSetSampler() */
+	TSharedPtr<FBlockTypeSetSampler> GetBlockTypeSetSampler(const FName& BlockTypeSetName);
+
+	/** Determine the block type name for spawning a new block. Play grids may default to this implementation but often have their own logic.
+	 *  Picks from the block type set of the cell's grid. The context's ExcludedBlockNames are ignored if not bUseExcludedBlockNames. */
+	bool GetRandomBlockTypeNameForCell(FName& FoundBlockTypeName, const FAddBlockContext& BlockContext, const bool bUseExcludedBlockNames = true);
 
 	/** Currently always returns AMMBlock::StaticClass() */
 	bool GetBlockClass(TSubclassOf<class AMMBlock>& BlockClass);
 
+	/** Get the loaded block class for the block type. Block classes are preloaded with the Blocks asset group.
+	 *  If that has not finished, the class is loaded synchronously. */
+	TSubclassOf<AMMBlock> GetLoadedBlockClass(const FBlockType& BlockType);
+
 	/** Speed, units/second, blocks move on the grid */
 	UFUNCTION(BlueprintPure)
 	float GetBlockMoveSpeed();
@@ -160,8 +175,13 @@ public:
 	UFUNCTION(BlueprintCallable)
 	int32 GetScoreForMatch(const UBlockMatch* Match);
 
-	/** Set the BlockTypeSetName */
-	bool SetBlockTypeSetName(const FName& BlockTypeSetName);
+	/** Score for a match of the given block types. BonusMatchSize is the number of blocks over the grid's minimum match size.
+	 *  Used by GetScoreForMatch and by AMMPlayGrid::ResolveMoveInstant for blocks that have no actor. */
+	static int32 GetScoreForMatchedTypes(const TArray<const FBlockType*>& MatchedTypes, const int32 BonusMatchSize);
+
+	/** Consolidate the goods of each block in a match of the given block types, and apply the types' overall goods multipliers.
+	 *  Used by GetGoodsForMatch and by AMMPlayGrid::ResolveMoveInstant for blocks that have no actor. */
+	static TArray<FGoodsQuantity> GetGoodsForMatchedTypes(const TArray<const FBlockType*>& MatchedTypes, const TArray<FGoodsQuantity>& BlockGoods);
 
 	/** Load and cache this group of assets. */
 	void CacheAssets(const TArray<FSoftObjectPath> AssetsToCache, const FName GroupName);
@@ -192,7 +212,8 @@ protected:
 
 	void InitWeightedBlockTypeSets(bool bForceRefresh = false);
 
-	bool InitWeightedBlockTypes(const FName& BlockTypeSetName, bool bForceRefresh = false);
+	/** Rebuild the existing block type set samplers in place, so grids holding them see the refreshed sets. */
+	void RebuildBlockTypeSetSamplers();
 
 	void InitCachedGoodsTypes(bool bForceRefresh = false);
 
@@ -200,6 +221,9 @@ protected:
 	
 	void OnAssetsCached(const TArray<FSoftObjectPath> CachedAssets, const FName GroupName);
 
+	/** Fill LoadedBlockClasses from the loaded block type classes. */
+	void CacheLoadedBlockClasses();
+
 	UFUNCTION(BlueprintNativeEvent)
 	void OnLoadComplete();
 
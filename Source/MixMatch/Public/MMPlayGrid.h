@@ -7,6 +7,8 @@
 #include "BlockMatch.h"
 #include "MatchAction.h"
 #include "MMPlayGridCell.h"
+#include "MMBoard.h"
+#include "BlockTypeSetSampler.h"
 #include "MMPlayGrid.generated.h"
 
 // Event dispatcher for when grid gives award for matches
@@ -24,6 +26,108 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnPlayerMoved, const AMMPlayGrid*,
 // Event dispatcher for when grid reaches max player moves
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnMaxPlayerMoves, const AMMPlayGrid*, Grid);
 
+
+/** Instanced mesh component drawing all of a grid's blocks that use one static mesh. */
+USTRUCT()
+struct FMMBlockInstanceSet
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY()
+	class UInstancedStaticMeshComponent* Component = nullptr;
+
+	/** Instances not used by any block. These are scaled to zero and reused before new instances are added. */
+	TArray<int32> FreeInstances;
+};
+
+
+/** Outcome of a move resolved in logic only. See AMMPlayGrid::ResolveMoveInstant */
+USTRUCT(BlueprintType)
+struct FMMInstantResolveResult
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Was the move valid? Nothing else is set if not. */
+	UPROPERTY(BlueprintReadOnly)
+	bool bValidMove = false;
+
+	/** Number of match steps, including the matches made by the move itself. */
+	UPROPERTY(BlueprintReadOnly)
+	int32 Cascades = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 MatchCount = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 BlocksMatched = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 BlocksAdded = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 Score = 0;
+
+	/** Total goods awarded for all matches. */
+	UPROPERTY(BlueprintReadOnly)
+	TArray<FGoodsQuantity> Goods;
+
+	/** Block type name in each cell after the move is resolved, indexed by cell number. None for empty cells. */
+	UPROPERTY(BlueprintReadOnly)
+	TArray<FName> FinalBlockTypes;
+};
+
+
+/** A player move made on a grid. See FMMGridRecording */
+USTRUCT(BlueprintType)
+struct FMMRecordedMove
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadWrite)
+	FIntPoint FromCoords = FIntPoint::NoneValue;
+
+	UPROPERTY(BlueprintReadWrite)
+	FIntPoint ToCoords = FIntPoint::NoneValue;
+
+	/** Was the move made with AMMPlayGrid::ResolveMoveInstant instead of MoveBlock? */
+	UPROPERTY(BlueprintReadWrite)
+	bool bInstant = false;
+};
+
+
+/** The seed and player moves of one grid game. Replaying it with AMMPlayGrid::StartReplay plays the same game again. */
+USTRUCT(BlueprintType)
+struct FMMGridRecording
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Seed of the grid's random stream when the game started. */
+	UPROPERTY(BlueprintReadWrite)
+	int32 Seed = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 SizeX = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	int32 SizeY = 0;
+
+	UPROPERTY(BlueprintReadWrite)
+	FName BlockTypeSetName;
+
+	/** Successful player moves, in order. */
+	UPROPERTY(BlueprintReadWrite)
+	TArray<FMMRecordedMove> Moves;
+};
+
+
 /** A match grid containing cells and blocks. */
 UCLASS(minimalapi)
 class AMMPlayGrid : public AActor
@@ -33,6 +137,7 @@ class AMMPlayGrid : public AActor
 public:
 
 	// Delegate event when grid gives awards for matches.
+	// Match objects are pooled and reused once all current matches finish, so listeners should not keep references to them.
 	UPROPERTY(BlueprintAssignable, Category = "EventDispatchers")
 	FOnMatchAwards OnMatchAwards;
 
@@ -111,6 +216,14 @@ public:
 	UPROPERTY()
 	TArray<UBlockMatch*> BlockMatches;
 
+	/** Match objects that are not in use. Matches are returned here after they are processed so new matches don't create new objects. */
+	UPROPERTY()
+	TArray<UBlockMatch*> BlockMatchPool;
+
+	/** Deactivated blocks that can be reused. Blocks are returned here when they are destroyed so new blocks don't spawn new actors. */
+	UPROPERTY()
+	TArray<AMMBlock*> BlockPool;
+
 	/** Currently selected block */
 	UPROPERTY()
 	AMMBlock* SelectedBlock;
@@ -142,29 +255,112 @@ protected:
 	UPROPERTY(EditAnywhere)
 	float DuplicateSpawnPreventionFactor = 0.5;
 
+	/** When the grid becomes locked, reshuffle the existing blocks instead of broadcasting OnGridLocked. 
+	 *  OnGridLocked is still broadcast if a reshuffle is not possible. */
+	UPROPERTY(EditAnywhere)
+	bool bReshuffleOnLock = false;
+
+	/** Reuse the actors of destroyed blocks for new blocks instead of destroying and spawning them. */
+	UPROPERTY(EditAnywhere)
+	bool bPoolBlocks = true;
+
+	/** Turbo mode. Block movement and settling finish immediately and each cascade is resolved in a single frame. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bFastForward = false;
+
+	/** Maximum grid steps per frame while fast forwarding. */
+	UPROPERTY(EditAnywhere)
+	int32 MaxFastForwardSteps = 32;
+
+	/** Seed for the grid's random stream. If 0, a new seed is picked each time play starts. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 RandomSeed = 0;
+
+	/** All random picks for this grid come from this stream: new blocks, goods drops and reshuffles. Seeded when play starts. */
+	FRandomStream RandStream;
+
+	/** Seed and player moves of the current grid game. */
+	UPROPERTY(BlueprintReadOnly)
+	FMMGridRecording Recording;
+
+	/** Recording being replayed, if IsReplaying(). */
+	FMMGridRecording ReplayRecording;
+
+	/** Index in ReplayRecording.Moves of the next move to replay. INDEX_NONE if not replaying. */
+	int32 ReplayMoveIndex = INDEX_NONE;
+
+	/** Draw blocks through one instanced mesh component per block mesh, owned by the grid, instead of each block drawing its own mesh.
+	 *  Blocks still handle their own clicks and gameplay. */
+	UPROPERTY(EditAnywhere)
+	bool bInstanceBlockMeshes = false;
+
+	/** Material for the instanced block meshes. Per instance custom data holds the block's color in 0-3 (RGBA) and damage percent in 4.
+	 *  If not set, the block class' BaseMaterial is used. */
+	UPROPERTY(EditAnywhere)
+	class UMaterialInterface* InstancedBlockMaterial = nullptr;
+
+	/** Instanced mesh components for blocks, by block mesh. Only used if bInstanceBlockMeshes. */
+	UPROPERTY()
+	TMap<UStaticMesh*, FMMBlockInstanceSet> BlockInstanceSets;
+
+	/** Draw the cell backgrounds through one instanced mesh on the grid. Cells' own meshes are hidden and the instances handle cell clicks. */
+	UPROPERTY(EditAnywhere)
+	bool bInstanceCellMeshes = false;
+
+	/** Material for the instanced cell backgrounds. Per instance custom data 0 is 1 for highlighted cells and 0 otherwise.
+	 *  If not set, the cell class' BaseMaterial is used. */
+	UPROPERTY(EditAnywhere)
+	class UMaterialInterface* InstancedCellMaterial = nullptr;
+
 	/** All of this grid's cells */
 	UPROPERTY()
 	TArray<AMMPlayGridCell*> Cells;
 
+	/** Headless model of the grid's contents. Kept in sync with the cells' current blocks. */
+	FMMBoard Board;
+
 	/** All of the blocks this grid has spawned. (that still exist) */
 	UPROPERTY()
-	TArray<AMMBlock*> Blocks;
+	FMMBlockSlotSet Blocks;
 
-	/** List of blocks that have been unsettled but not yet settled. */
-	UPROPERTY(BlueprintReadOnly)
-	TArray<AMMBlock*> UnsettledBlocks;
+	/** List of blocks that have been unsettled but not yet settled. See GetUnsettledBlocks() */
+	UPROPERTY()
+	FMMBlockSlotSet UnsettledBlocks;
 
-	/** Queue of blocks to be unsettled during the next settle tick. */
-	UPROPERTY(BlueprintReadOnly)
-	TArray<AMMBlock*> ToBeUnsettledBlocks;
+	/** Queue of blocks to be unsettled during the next settle tick. See GetToBeUnsettledBlocks() */
+	UPROPERTY()
+	FMMBlockSlotSet ToBeUnsettledBlocks;
 
-	/** List of blocks to check for adjacent matches. */
-	UPROPERTY(BlueprintReadOnly)
-	TArray<AMMBlock*> BlocksToCheck;
+	/** List of blocks to check for adjacent matches. See GetBlocksToCheck() */
+	UPROPERTY()
+	FMMBlockSlotSet BlocksToCheck;
 
 	/** Blocks to be destroyed during AllMatchesFinished() */
 	UPROPERTY()
-	TArray<AMMBlock*> BlocksToDestroy;
+	FMMBlockSlotSet BlocksToDestroy;
+
+	/** Columns with cells that became open since their settling was last planned. One bit per column. See PlanColumnSettle() */
+	TBitArray<> ColumnsToSettle;
+
+	/** True while PlanColumnSettle is moving blocks, so the cells it opens are not queued again. */
+	bool bPlanningSettle = false;
+
+	/** Copy of a block context with names added by AddRandomBlockInCell. Kept so the name arrays don't need to be allocated for each new block. See SetRandomBlockContext() */
+	FAddBlockContext RandomBlockContext;
+
+	/** Block type ids that would complete a run in the cell AddRandomBlockInCell is filling. Kept to avoid an allocation for each new block. */
+	TBitArray<> CompletingRunTypeIds;
+
+	/** Sampler for BlockTypeSetName, shared with the game mode. See GetBlockTypeSetSampler() */
+	TSharedPtr<FBlockTypeSetSampler> BlockTypeSetSampler;
+
+	/** Mesh scale applied to new blocks of each class and mesh when bScaleBlocks is set. See GetBlockRescale() */
+	TMap<TPair<const UClass*, const UStaticMesh*>, FVector> BlockRescales;
+
+	/** Grid slots of destroyed blocks, reused for new blocks. See AMMBlock::GetGridSlot() */
+	TArray<int32> FreeBlockSlots;
+
+	int32 NextBlockSlot = 0;
 
 	/** Simple queue of sounds to play. Sounds are played and queue is emptied on each tick. */
 	UPROPERTY()
@@ -176,15 +372,20 @@ protected:
 	/** Have all current matches finished? */
 	bool bAllMatchesFinished = false;
 
-	/** Has the grid been checked for locked state? And if so, is the grid locked? i.e. no valid moves available. (excluding special powers/actions) */
-	EMMGridLockState GridLockedState = EMMGridLockState::Unchecked;
+	/** See GetBlockMoveSpeed() */
+	float BlockMoveSpeed = 100.f;
+
+	/** Fast forward until the grid is idle. See FastForward() */
+	bool bFastForwardOnce = false;
 
-	/** The last coords that were checked for locked grid status. 
-	 *  This allows us to check for locked state over the span of many ticks. */
-	FIntPoint GridLockCheckCoords = FIntPoint::ZeroValue;
+	/** For each move curve, the time for a unit move at unit speed to reach each 1/32 of the move. See GetMoveAlpha() */
+	TMap<const UCurveFloat*, TArray<float>> MoveCurveTimes;
 
-	/** How many potential move matches should be checked each tick.  */
-	int32 GridLockChecksPerTick = 5;
+	/** Get (or build) the MoveCurveTimes table for the curve. */
+	const TArray<float>& GetMoveCurveTimes(const UCurveFloat* Curve);
+
+	/** Has the grid been checked for locked state? And if so, is the grid locked? i.e. no valid moves available. (excluding special powers/actions) */
+	EMMGridLockState GridLockedState = EMMGridLockState::Unchecked;
 
 	/** Inventory for this grid */
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly)
@@ -212,6 +413,14 @@ private:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, meta = (AllowPrivateAccess = "true"))
 	class UStaticMeshComponent* BlockToggleControlMesh;
 
+	/** Instanced mesh for the cell backgrounds. See AMMPlayGridCell::BackgroundInstanceIndex. Only used if bInstanceCellMeshes. */
+	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
+	class UInstancedStaticMeshComponent* CellBackgroundInstances;
+
+	/** Cell drawn by each cell background instance. */
+	UPROPERTY()
+	TArray<AMMPlayGridCell*> CellBackgroundInstanceCells;
+
 #if WITH_EDITORONLY_DATA
 	/** Actor billboard */
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
@@ -228,6 +437,33 @@ public:
 
 	void SettleTick(float DeltaSeconds);
 
+	/** Runs MoveTick and MatchTick for all of the grid's moving and matching blocks. Blocks do not tick themselves.
+	 *  Returns the number of blocks that were ticked. */
+	int32 BlockMotionTick(float DeltaSeconds);
+
+	/** Turn the grid's tick back on. The grid stops ticking when it is idle, so anything that gives the grid work must call this.
+	 *  ex: changing the grid state, queueing blocks to destroy or invalidating the locked state. */
+	void WakeGrid();
+
+	/** Is the grid settled with nothing queued and its locked state known? */
+	bool IsGridIdle() const;
+
+	/** Block movement speed from the game mode. Updated once at the start of each grid tick. */
+	FORCEINLINE float GetBlockMoveSpeed() const { return BlockMoveSpeed; }
+
+	/** Runs one step of the grid's state machine, including block motion. Returns the number of moving or matching blocks. */
+	int32 StepGrid(float DeltaSeconds);
+
+	/** Jump all current block movement and settling to its end, and resolve the resulting cascade, in the next grid tick. */
+	UFUNCTION(BlueprintCallable)
+	void FastForward();
+
+	FORCEINLINE bool IsFastForwarding() const { return bFastForward || bFastForwardOnce; }
+
+	/** Fraction (0 - 1) of a straight line move of the given distance that is complete after ElapsedTime, at the block move speed.
+	 *  Curve optionally scales the speed by fraction complete, as AMMBlock::MoveCurve. Always 1 while fast forwarding. */
+	float GetMoveAlpha(const UCurveFloat* Curve, const float Distance, const float ElapsedTime);
+
 	/** Called when player begins play on this grid.
 	 *  If overridden in BP, parent should be called. */
 	UFUNCTION(BlueprintNativeEvent, BlueprintCallable)
@@ -237,6 +473,34 @@ public:
 	UFUNCTION(BlueprintNativeEvent)
 	void StopPlayGrid();
 
+	/** Blocks that have been unsettled but not yet settled. 
+	 *  Removing a block from the set moves the last block into its place, so the order is not the order blocks were added. */
+	UFUNCTION(BlueprintPure)
+	const TArray<AMMBlock*>& GetUnsettledBlocks() const { return UnsettledBlocks.Blocks; }
+
+	/** Blocks to be unsettled during the next settle tick. Not in the order they were added. See GetUnsettledBlocks() */
+	UFUNCTION(BlueprintPure)
+	const TArray<AMMBlock*>& GetToBeUnsettledBlocks() const { return ToBeUnsettledBlocks.Blocks; }
+
+	/** Blocks to check for adjacent matches. Not in the order they were added. See GetUnsettledBlocks() */
+	UFUNCTION(BlueprintPure)
+	const TArray<AMMBlock*>& GetBlocksToCheck() const { return BlocksToCheck.Blocks; }
+
+	/** The grid's random stream. See RandStream. */
+	FORCEINLINE FRandomStream& GetRandomStream() { return RandStream; }
+
+	/** Seed and player moves of the current grid game. */
+	UFUNCTION(BlueprintPure)
+	const FMMGridRecording& GetRecording() const { return Recording; }
+
+	/** Start play again with the recording's seed, then make its moves in order, each one once the grid is idle.
+	 *  The grid must have the same size and block type set as when the recording was made. Use bFastForward to replay quickly. */
+	UFUNCTION(BlueprintCallable)
+	bool StartReplay(const FMMGridRecording& RecordingToReplay);
+
+	UFUNCTION(BlueprintPure)
+	bool IsReplaying() const { return ReplayMoveIndex != INDEX_NONE; }
+
 	/** Minimum number of matching blocks to qualify as a match */
 	UFUNCTION(BlueprintPure)
 	int32 GetMinimumMatchSize();
@@ -252,6 +516,9 @@ public:
 	UFUNCTION(BlueprintPure)
 	FName GetBlockTypeSetName();
 
+	/** Get the sampler that picks random block types from this grid's BlockTypeSet. Returns nullptr if the set is not found. */
+	FBlockTypeSetSampler* GetBlockTypeSetSampler();
+
 	/** Add a number of moves to the max allowed for the current grid. */
 	UFUNCTION(BlueprintCallable)
 	void AddPlayerMaxMoveCount(const int32 MovesToAdd);
@@ -263,14 +530,28 @@ public:
 
 	//### Spawn Destroy **/
 
-	/** Spawns the grid's cells (and cell background meshes) */
+	/** Spawns the grid's cells (and cell background meshes). Existing cells are kept if the number of cells has not changed. */
 	UFUNCTION(BlueprintCallable, CallInEditor)
 	void SpawnGrid();
 
-	/** Fill the grid with blocks. */
+	/** Add the instance that draws the cell's background, if bInstanceCellMeshes.
+	 *  All instances share one mesh, so a cell with a different mesh than the first instanced cell keeps drawing its own mesh. */
+	void AddCellBackgroundInstance(AMMPlayGridCell* Cell);
+
+	/** Highlight the cell's background instance. Returns false if cell backgrounds are not instanced. */
+	bool HighlightCellInstance(const AMMPlayGridCell* Cell, const bool bOn);
+
+	/** Get the cell whose background instance was hit. nullptr if the hit was not on a cell background instance. */
+	AMMPlayGridCell* GetCellForBackgroundHit(const FHitResult& Hit);
+
+	/** Fill the grid with blocks. The filled grid has no matches and at least one valid move. */
 	UFUNCTION(BlueprintCallable, CallInEditor)
 	void FillGridBlocks();
 
+	/** If the grid has no valid move, replace one mobile block with a random block, picked the same way as filling the grid,
+	 *  from the types that give the grid a move without making a match. Returns true if the grid has a valid move. */
+	bool EnsureValidMove();
+
 	/** Destroy all blocks and cells in the grid. Does not destroy self. */
 	UFUNCTION(BlueprintCallable, CallInEditor)
 	void DestroyGrid();
@@ -279,12 +560,31 @@ public:
 	UFUNCTION(BlueprintCallable, CallInEditor)
 	void DestroyBlocks();
 
+	/** Get a block actor of the given class. Reuses a pooled block if there is one, otherwise spawns a new block.
+	 *  The block is not attached to the grid or placed in a cell. */
+	AMMBlock* AcquireBlock(TSubclassOf<AMMBlock> BlockClass);
+
+	/** Remove the block from the grid. The block is deactivated and pooled if bPoolBlocks, otherwise it is destroyed. */
+	void ReleaseBlock(AMMBlock* Block);
+
+	/** Destroy all pooled block actors. */
+	void EmptyBlockPool();
+
+	/** Draw the block with an instance in the grid's instanced mesh for the block's mesh, and hide the block's own mesh. */
+	bool AddBlockInstance(AMMBlock* Block);
+
+	/** Free the block's mesh instance and show the block's own mesh again. */
+	void RemoveBlockInstance(AMMBlock* Block);
+
 	//### Add Blocks **/
 
 	// Base class implementation calls GameMode->GetRandomBlockTypeNameForCell
 	UFUNCTION(BlueprintNativeEvent)
 	bool GetRandomBlockTypeNameForCell(FName& FoundBlockTypeName, const FAddBlockContext& BlockContext);
 
+	/** Scale to apply to the block's mesh so it fills BlockSize - BlockMargin. Measured once per block class and static mesh, and cached. */
+	FVector GetBlockRescale(AMMBlock* Block);
+
 	/** Add a new block of the given block type into the given cell. */
 	UFUNCTION(BlueprintCallable)
 	AMMBlock* AddBlockInCell(const FName& BlockType, const FAddBlockContext& BlockContext);
@@ -292,15 +592,34 @@ public:
 	/** Add a new block of a random block type to the given cell. */
 	UFUNCTION(BlueprintCallable)
 	virtual AMMBlock* AddRandomBlockInCell(const FAddBlockContext& BlockContext);
+
+	/** Called for each random block that enters the grid, after it is added. NewBlock is nullptr if the block was added to a board
+	 *  resolved by ResolveMoveInstant, where the block may be matched away before any actor is spawned for it. */
+	virtual void OnRandomBlockTypeAdded(const FBlockType& BlockType, AMMBlock* NewBlock);
+
+	/** Called for a random block that is taken back out of the grid before it could be matched, such as a block replaced by EnsureValidMove.
+	 *  Called before the block is released. */
+	virtual void OnRandomBlockRemoved(AMMBlock* Block);
+
+	/** Registry ids of all block types that GetRandomBlockTypeNameForCell can pick. Base class returns the types in the grid's block type set. */
+	virtual const TArray<int16>& GetSpawnableBlockTypeIds();
 		
 	/** Drop a random blocks from above grid, to fall into given cell.
 	 *  This will drop enough blocks to fill the available empty space in the column. */
 	UFUNCTION(BlueprintCallable)
 	AMMBlock* DropRandomBlockInColumn(UPARAM(ref) AMMPlayGridCell* Cell);
 
-	/** Called when the given cell has become unoccupied. */
+	/** Called when the given cell has become unoccupied. Queues the cell's column to have its settling planned. */
 	void CellBecameOpen(AMMPlayGridCell* Cell);
 
+	/** Plan settling for all columns queued by CellBecameOpen. */
+	void PlanColumnSettles();
+
+	/** Work out where every block in the column settles to, in one pass from the bottom up, and give each block that must fall its final cell.
+	 *  Blocks never fall past immobile or matched blocks. Blocks falling into the grid fill the cells left at the top, in the order they were dropped.
+	 *  Blocks given a new cell are queued to be unsettled, and move to it when they settle. */
+	void PlanColumnSettle(const int32 Column);
+
 	//### Get Cells & Blocks **/
 
 	// Get the total number of cells in the grid.
@@ -319,6 +638,10 @@ public:
 	UFUNCTION(BlueprintPure)
 	TArray<AMMPlayGridCell*> GetCellNeighbors(const AMMPlayGridCell* Cell, const bool bIncludeDiagonal = false);
 
+	/** Get the cells adjacent to any block in the match, not including the match's own cells. 
+	 *  Uses a bitboard dilation of the match when the grid fits in an FMMBitBoard. */
+	void GetMatchNeighbors(UBlockMatch* Match, TArray<AMMPlayGridCell*>& OutNeighbors, const bool bIncludeDiagonal = false);
+
 	/** Get the cell at the top of the column. This is the top cell in the grid. i.e. it does not include blocks that are falling into 
 	 * the grid but are not yet in any grid cell. */
 	UFUNCTION(BlueprintPure)
@@ -328,6 +651,20 @@ public:
 	UFUNCTION(BlueprintPure)
 	AMMBlock* GetBlock(const FIntPoint& Coords);
 
+	//### Board Model **/
+
+	/** The headless board model for this grid. */
+	FORCEINLINE const FMMBoard& GetBoard() const { return Board; }
+
+	/** Rebuild the whole board model from the current state of the cells. */
+	void SyncBoard();
+
+	/** Update the board model for a single cell from the cell's current block. */
+	void SyncBoardCell(const AMMPlayGridCell* Cell);
+
+	/** Update the board model for the cell the given block occupies, if any. */
+	void SyncBoardBlock(const AMMBlock* Block);
+
 	//## Grid & Cell Locations **/
 
 	/** Translates grid coordinates to world coordinates */
@@ -368,13 +705,34 @@ public:
 	UFUNCTION()
 	void OnFingerPressedToggleBlocks(ETouchIndex::Type FingerIndex, UPrimitiveComponent* TouchedComponent);
 
+	UFUNCTION()
+	void CellBackgroundClicked(UPrimitiveComponent* ClickedComp, FKey ButtonClicked);
+
+	UFUNCTION()
+	void OnFingerPressedCellBackground(ETouchIndex::Type FingerIndex, UPrimitiveComponent* TouchedComponent);
+
 	/* Move a block from one cell to given adjacent cell.
 	 * If target cell is occupied by a moveable block, the blocks will be swapped. 
 	 * Returns true if a match was found and the move was successful. */
 	UFUNCTION(BlueprintCallable)
 	bool MoveBlock(UPARAM(ref) AMMBlock* MovingBlock, UPARAM(ref) AMMPlayGridCell* ToCell);
 
+	/** Resolve the move of the block at FromCoords to ToCoords, and all of its cascades, on a copy of the board in logic only. No actors are touched and nothing animates.
+	 *  New blocks are picked with GetRandomBlockTypeNameForCell. Matches made by the move itself are awarded by the game mode's GetScoreForMatch and GetGoodsForMatch,
+	 *  as for an animated move. Blocks in later cascades have no actors, so their awards use the same math with each block type's points and match goods,
+	 *  and Blueprint overrides of block goods are not called for them. Match actions, game effects and block damage are not applied.
+	 *  If bApplyToGrid, the awards and move turn are given, OnRandomBlockTypeAdded is called for each new block, and the grid's blocks are replaced to match the final board.
+	 *  Otherwise the grid's random stream is restored afterwards, so overrides of GetRandomBlockTypeNameForCell and of block and match goods must not change the grid's state.
+	 *  A preview does not see state changes that OnRandomBlockTypeAdded would make during the cascade, such as a recipe grid running out of ingredients.
+	 *  Can only be done while the grid is idle. Returns true if the move was valid. */
+	UFUNCTION(BlueprintCallable)
+	bool ResolveMoveInstant(const FIntPoint& FromCoords, const FIntPoint& ToCoords, FMMInstantResolveResult& Result, const bool bApplyToGrid = false);
+
+	/** Replace blocks in cells whose type differs from the given board, which must be a resolved copy of this grid's board. No blocks animate. */
+	void ApplyBoardToGrid(const FMMBoard& NewBoard);
+
 	/** Checks a single block for a match if the block were moved in the given direction (swapping with neighboring block, if any.).
+	 *  The move is evaluated on an overlay of the board, so the grid's cells and blocks are not changed.
 	 *  Note: North is increasing Y axis (up the gri), South is decreasing Y axis (down the grid). West is decreasing on X axis, East increasing X axis. */
 	bool BlockMoveHasMatch(const AMMBlock* CheckBlock, const EMMDirection DirectionToCheck);
 
@@ -388,21 +746,18 @@ public:
 	UFUNCTION(BlueprintCallable)
 	bool CheckFlaggedForMatches();
 
-	//UFUNCTION(BlueprintCallable)
-	//bool CheckForMatches(UPARAM(ref) AMMBlock* CheckBlock, UPARAM(ref) UBlockMatch** HorizMatchPtr, UBlockMatch** VertMatchPtr, const bool bMarkBlocks = true);
-	bool CheckForMatches(AMMBlock* CheckBlock, UBlockMatch** HorizMatchPtr, UBlockMatch** VertMatchPtr, const bool bMarkBlocks = true);
+	/** Find all matches on the board that include any of the given blocks, in a single scan of the board's rows and columns.
+	 *  Blocks in found matches are marked as matched. Returns the number of matches added to OutMatches. */
+	int32 FindMatchesForBlocks(const TArray<AMMBlock*>& CheckBlocks, TArray<UBlockMatch*>& OutMatches);
 
-	//UFUNCTION(BlueprintCallable)
-	//int32 MatchHorizontal(UPARAM(ref) AMMBlock* StartBlock, UPARAM(ref) UBlockMatch** MatchPtr, const bool bMarkBlocks = true);
-	int32 MatchHorizontal(AMMBlock* StartBlock, UBlockMatch** MatchPtr, const bool bMarkBlocks = true);
+	/** Create a match object for a run found on the board and mark its blocks as matched. */
+	UBlockMatch* CreateBlockMatch(const FMMBoardMatch& BoardMatch);
 
-	//UFUNCTION(BlueprintCallable)
-	//int32 MatchVertical(UPARAM(ref) AMMBlock* StartBlock, UPARAM(ref) UBlockMatch** MatchPtr, const bool bMarkBlocks = true);
-	int32 MatchVertical(AMMBlock* StartBlock, UBlockMatch** MatchPtr, const bool bMarkBlocks = true);
+	/** Get an empty match object from the pool. Creates a new one if the pool is empty. */
+	UBlockMatch* AcquireBlockMatch();
 
-	//UFUNCTION(BlueprintCallable)
-	//int32 MatchDirection(UPARAM(ref) AMMBlock* StartBlock, const EMMDirection Direction, UBlockMatch** MatchPtr, const bool bRecurse = true);
-	int32 MatchDirection(AMMBlock* StartBlock, const EMMDirection Direction, UBlockMatch** MatchPtr, const bool bRecurse = true);
+	/** Reset the match and return it to the pool. */
+	void ReleaseBlockMatch(UBlockMatch* Match);
 
 	UFUNCTION(BlueprintCallable)
 	void SortMatches(/*const bool bForceSort = false*/);
@@ -418,11 +773,20 @@ public:
 
 	//### Check for Locked Grid
 
-	/** Check part of the grid to see if grid is locked.
-	 * i.e. check for potential moves that would result in a match. */
+	/** Check if the grid is locked. i.e. there are no potential moves that would result in a match. 
+	 *  Uses the board's move index, which is only updated around cells that changed since the last check. */
 	UFUNCTION()
 	EMMGridLockState CheckGridIsLocked();
 
+	/** Check the grid for locked state if it has not been checked since it last changed. Broadcasts OnGridLocked if it is locked. */
+	void UpdateGridLockedState();
+
+	/** Move the grid's mobile blocks to new cells so the grid has no matches and at least one valid move. 
+	 *  Existing blocks are moved, none are spawned or destroyed. Immobile blocks stay where they are.
+	 *  Can only be done while the grid is in the normal state. Returns true if the blocks were reshuffled. */
+	UFUNCTION(BlueprintCallable)
+	bool ReshuffleBlocks();
+
 
 	//### Settling
 
@@ -431,8 +795,6 @@ public:
 
 	void UnsettleBlock(AMMBlock* Block);
 
-	void UnsettleBlockAboveCell(AMMPlayGridCell* Cell);
-
 	void AddScore(int32 PointsToAdd);
 		
 	void BlockFinishedMoving(AMMBlock* Block, bool bBlockMoved = true);
@@ -471,6 +833,19 @@ protected:
 	/** Sets up the BlocksFallingIntoGrid map based on grid size. */
 	void InitBlocksFallingIntoGrid();
 
+	/** Keeps a block's mesh instance at its mesh component's transform. */
+	void OnBlockMeshTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
+	/** Seed RandStream for a new grid game and start a new Recording with the seed. Called by StartPlayGrid before the grid is filled.
+	 *  Uses the replay's seed if replaying, then RandomSeed if set, otherwise a new seed. */
+	virtual void SeedRandomStream();
+
+	/** Make the next move of the replay. Called once the grid is idle. Returns false if the replay has ended. */
+	bool StepReplay();
+
+	/** Set RandomBlockContext to a copy of the given context, keeping its name arrays' allocations. */
+	void SetRandomBlockContext(const FAddBlockContext& BlockContext);
+
 };
 
 
@@ -27,6 +27,9 @@ public:
 	UPROPERTY(BlueprintReadWrite, meta = (ExposeOnSpawn = "true"))
 	int32 Y;
 
+	/** Index of the grid's cell background instance drawing this cell. INDEX_NONE if the cell draws its own mesh. */
+	int32 BackgroundInstanceIndex = INDEX_NONE;
+
 	/** Are we currently active? */
 	bool bIsActive;
 
@@ -67,6 +70,9 @@ public:
 	UFUNCTION(BlueprintCallable)
 	FIntPoint GetCoords() const;
 
+	/** Set the block occupying this cell. Keeps the owning grid's board model in sync. */
+	void SetCurrentBlock(class AMMBlock* NewBlock);
+
 	/* Get the world location for this cell's block */
 	UFUNCTION(BlueprintCallable)
 	FVector GetBlockWorldLocation();
@@ -51,12 +51,16 @@ protected:
 	UPROPERTY()
 	TArray<FGoodsQuantity> IngredientBlockDropOdds;
 
+	/** See GetSpawnableBlockTypeIds(). Rebuilt in place on each call. */
+	TArray<int16> SpawnableBlockTypeIds;
+
+	/** Ingredient goods deducted from InputGoodsInventory when each block was added, indexed by the block's grid slot. */
+	TArray<TArray<FGoodsQuantity>> DeductedIngredientGoods;
+
 public:
 
 	ARecipePlayGrid();
 
-	virtual void StartPlayGrid_Implementation() override;
-
 	/** This returns all unused ingredients to player inventory. Does not call base class. */
 	virtual void StopPlayGrid_Implementation() override;
 
@@ -102,10 +106,19 @@ public:
 	virtual bool GetRandomBlockTypeNameForCell_Implementation(FName& FoundBlockTypeName, const FAddBlockContext& BlockContext) override;
 
 	/** Override base class so we can deduct ingredient goods from inventory if relevant. */
-	virtual AMMBlock* AddRandomBlockInCell(const FAddBlockContext& BlockContext) override;
+	virtual void OnRandomBlockTypeAdded(const FBlockType& BlockType, AMMBlock* NewBlock) override;
+
+	/** Override base class so we can refund the ingredient goods deducted for the block. */
+	virtual void OnRandomBlockRemoved(AMMBlock* Block) override;
+
+	/** Adds the recipe's ingredient block types to the base class's types. */
+	virtual const TArray<int16>& GetSpawnableBlockTypeIds() override;
 
 protected:
 
+	/** Also rebuilds the ingredient drop odds, which draw from the grid's stream. */
+	virtual void SeedRandomStream() override;
+
 	void InitIngredientBlockDropOdds(const bool bForceRefresh = false);
 };
 